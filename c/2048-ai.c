@@ -1,5 +1,6 @@
 #define SUPPORT_64BIT 1
 #define AI_SOURCE 1
+#define AI_BITOPS 1
 #include "arch.h"
 #include <math.h>
 
@@ -19,8 +20,8 @@ typedef struct {
     score_heur_t heuristic;
 } trans_table_entry_t;
 
-#include "cmap.c"
-typedef map_t(board_t, trans_table_entry_t) trans_table_t;
+#include "imap.c"
+typedef imap_t(trans_table_entry_t) trans_table_t;
 #endif
 
 enum {
@@ -42,6 +43,9 @@ static const score_heur_t SCORE_EMPTY_WEIGHT = 270.0f;
 static const score_heur_t CPROB_THRESH_BASE = 0.0001f;
 #if ENABLE_CACHE
 static const row_t CACHE_DEPTH_LIMIT = 15;
+
+/* one table per root move, each root move is searched by a single thread */
+static trans_table_t cache_table[4];
 #endif
 
 typedef struct {
@@ -53,7 +57,7 @@ typedef struct {
     long moves_evaled;
     int depth_limit;
 #if ENABLE_CACHE
-    trans_table_t trans_table;
+    trans_table_t *trans_table;
 #endif
 } eval_state;
 
@@ -75,6 +79,9 @@ static score_t *score_table;
 static score_heur_t *score_heur_table;
 #else
 #define TABLESIZE 8192
+/* the top 3 bits of a row pick the segment, the low 13 bits the entry */
+#define TABLE_SEGMENT(row) ((row) >> 13)
+#define TABLE_INDEX(row) ((row) & (TABLESIZE - 1))
 static row_t *row_table[8];
 static score_heur_t *score_heur_table[8];
 #endif
@@ -143,6 +150,18 @@ static int count_empty(board_t x) {
     return (int)(x & 0xf);
 }
 
+/* bit i set if cell i (nibble i) is empty */
+static unsigned int empty_mask(board_t x) {
+    x |= (x >> 2) & W64LIT(0x3333333333333333);
+    x |= x >> 1;
+    x = ~x & W64LIT(0x1111111111111111);
+    x = (x | (x >> 3)) & W64LIT(0x0303030303030303);
+    x = (x | (x >> 6)) & W64LIT(0x000F000F000F000F);
+    x = (x | (x >> 12)) & W64LIT(0x000000FF000000FF);
+    x = (x | (x >> 24)) & W64LIT(0x000000000000FFFF);
+    return (unsigned int)x;
+}
+
 static void init_tables(void) {
     row_t row = 0, result = 0;
 
@@ -220,7 +239,7 @@ static void init_tables(void) {
                            SCORE_MONOTONICITY_WEIGHT * _min(monotonicity_left, monotonicity_right) -
                            SCORE_SUM_WEIGHT * sum);
 #else
-        score_heur_table[row / TABLESIZE][row % TABLESIZE] =
+        score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] =
             (score_heur_t)(SCORE_LOST_PENALTY +
                            SCORE_EMPTY_WEIGHT * empty +
                            SCORE_MERGES_WEIGHT * merges -
@@ -256,7 +275,7 @@ static void init_tables(void) {
         row_left_table[row] = row ^ result;
         row_right_table[rev_row] = rev_row ^ rev_result;
 #else
-        row_table[row / TABLESIZE][row % TABLESIZE] = row ^ result;
+        row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] = row ^ result;
 #endif
     } while (row++ != 0xFFFF);
 }
@@ -354,23 +373,23 @@ static board_t execute_move(board_t board, int move) {
         board = transpose(board);
         for (i = 0; i < 4; ++i) {
             row = (board >> (i << 4)) & ROW_MASK;
-            ret ^= unpack_col(row_table[row / TABLESIZE][row % TABLESIZE]) << (i << 2);
+            ret ^= unpack_col(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)]) << (i << 2);
         }
     } else if (move == DOWN) {
         board = transpose(board);
         for (i = 0; i < 4; ++i) {
             row = reverse_row((board >> (i << 4)) & ROW_MASK);
-            ret ^= unpack_col(reverse_row(row_table[row / TABLESIZE][row % TABLESIZE])) << (i << 2);
+            ret ^= unpack_col(reverse_row(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)])) << (i << 2);
         }
     } else if (move == LEFT) {
         for (i = 0; i < 4; ++i) {
             row = (board >> (i << 4)) & ROW_MASK;
-            ret ^= (board_t)(row_table[row / TABLESIZE][row % TABLESIZE]) << (i << 4);
+            ret ^= (board_t)(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)]) << (i << 4);
         }
     } else if (move == RIGHT) {
         for (i = 0; i < 4; ++i) {
             row = reverse_row((board >> (i << 4)) & ROW_MASK);
-            ret ^= (board_t)(reverse_row(row_table[row / TABLESIZE][row % TABLESIZE])) << (i << 4);
+            ret ^= (board_t)(reverse_row(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)])) << (i << 4);
         }
     }
     return ret;
@@ -400,7 +419,7 @@ static score_heur_t score_heur_helper(board_t board) {
 
     for (i = 0; i < 4; ++i) {
         row = (board >> (i << 4)) & ROW_MASK;
-        score_heur += score_heur_table[row / TABLESIZE][row % TABLESIZE];
+        score_heur += score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
     }
     return score_heur;
 }
@@ -488,8 +507,7 @@ static score_heur_t score_move_node(eval_state *state, board_t board, score_heur
 static score_heur_t score_tilechoose_node(eval_state *state, board_t board, score_heur_t cprob) {
     int num_open = 0;
     score_heur_t res = 0.0f;
-    board_t tmp = board;
-    board_t tile_2 = 1;
+    unsigned int mask = 0;
 
     if (cprob < CPROB_THRESH_BASE || state->curdepth >= state->depth_limit) {
         state->maxdepth = _max(state->curdepth, state->maxdepth);
@@ -499,7 +517,7 @@ static score_heur_t score_tilechoose_node(eval_state *state, board_t board, scor
 
 #if ENABLE_CACHE
     if (state->curdepth < CACHE_DEPTH_LIMIT) {
-        trans_table_entry_t *entry = (trans_table_entry_t *)map_get(&state->trans_table, board);
+        trans_table_entry_t *entry = (trans_table_entry_t *)imap_get(state->trans_table, board);
         if (entry != NULL) {
             if (entry->depth <= state->curdepth) {
                 state->cachehits++;
@@ -509,16 +527,16 @@ static score_heur_t score_tilechoose_node(eval_state *state, board_t board, scor
     }
 #endif
 
-    num_open = count_empty(board);
+    mask = empty_mask(board);
+    num_open = popcount(mask);
     cprob /= num_open;
 
-    while (tile_2) {
-        if ((tmp & 0xf) == 0) {
-            res += score_move_node(state, board | tile_2, cprob * 0.9f) * 0.9f;
-            res += score_move_node(state, board | (tile_2 << 1), cprob * 0.1f) * 0.1f;
-        }
-        tmp >>= 4;
-        tile_2 <<= 4;
+    while (mask) {
+        board_t tile_2 = (board_t)1 << (ctz(mask) << 2);
+
+        res += score_move_node(state, board | tile_2, cprob * 0.9f) * 0.9f;
+        res += score_move_node(state, board | (tile_2 << 1), cprob * 0.1f) * 0.1f;
+        mask &= mask - 1;
     }
     res = res / num_open;
 
@@ -527,7 +545,7 @@ static score_heur_t score_tilechoose_node(eval_state *state, board_t board, scor
         trans_table_entry_t entry;
         entry.depth = state->curdepth;
         entry.heuristic = res;
-        map_set(&state->trans_table, board, entry);
+        imap_set(state->trans_table, board, entry);
     }
 #endif
 
@@ -565,7 +583,8 @@ static score_heur_t score_toplevel_move(board_t board, int move) {
 
     memset(&state, 0x00, sizeof(eval_state));
 #if ENABLE_CACHE
-    map_init(&state.trans_table, NULL, NULL);
+    imap_clear(&cache_table[move]);
+    state.trans_table = &cache_table[move];
 #endif
     state.depth_limit = get_depth_limit(board);
     if (board != newboard)
@@ -574,18 +593,33 @@ static score_heur_t score_toplevel_move(board_t board, int move) {
     printf("Move %d: result %f: eval'd %ld moves (%ld no moves, %ld table hits, %ld cache hits, %ld cache size) (maxdepth=%d)\n",
          move, res, state.moves_evaled, state.nomoves, state.tablehits, state.cachehits,
 #if ENABLE_CACHE
-         (long)state.trans_table.base.nnodes,
+         (long)imap_size(state.trans_table),
 #else
          0L,
 #endif
          state.maxdepth);
 
-#if ENABLE_CACHE
-    map_delete(&state.trans_table);
-#endif
     return res;
 }
 
+#if ENABLE_CACHE
+static void cache_init(void) {
+    int i = 0;
+
+    for (i = 0; i < 4; ++i) {
+        imap_init(&cache_table[i]);
+    }
+}
+
+static void cache_uninit(void) {
+    int i = 0;
+
+    for (i = 0; i < 4; ++i) {
+        imap_delete(&cache_table[i]);
+    }
+}
+#endif
+
 #if MULTI_THREAD
 static void thrd_worker(void *param) {
     thrd_context *pcontext = (thrd_context *)param;
@@ -605,6 +639,8 @@ int find_best_move(board_t board) {
 #if MULTI_THREAD
     thrd_context context[4];
     THREADPOOL_CTX *ctx = get_thrd_pool();
+    THREADGROUP_CTX group = { NULL };
+    THREADTASK tasks[4];
 #else
     score_heur_t res[4] = { 0.0f };
 #endif
@@ -617,9 +653,16 @@ int find_best_move(board_t board) {
         context[move].board = board;
         context[move].move = move;
         context[move].res = 0.0f;
-        threadpool_addtask(ctx, thrd_worker, &context[move]);
+        tasks[move].func = thrd_worker;
+        tasks[move].param = &context[move];
+    }
+    if (threadgroup_init(&group)) {
+        threadpool_addtasks(ctx, tasks, 4, &group);
+        threadgroup_uninit(&group);
+    } else {
+        threadpool_addtasks(ctx, tasks, 4, NULL);
+        threadpool_waitalltask(ctx);
     }
-    threadpool_waitalltask(ctx);
     for (move = 0; move < 4; move++) {
         if (context[move].res > best) {
             best = context[move].res;
@@ -695,11 +738,20 @@ void play_game(get_move_func_t get_move) {
 
     print_board(board);
     printf("Game over. Your score is %ld.\n", current_score);
+#if MULTI_THREAD
+    threadpool_dumpstats(ctx, stdout);
+#endif
 }
 
 int main() {
     alloc_tables();
+#if ENABLE_CACHE
+    cache_init();
+#endif
     play_game(find_best_move);
+#if ENABLE_CACHE
+    cache_uninit();
+#endif
     free_tables();
     return 0;
 }
@@ -0,0 +1,113 @@
+#define AI_SOURCE 1
+#define NO_CLEAR_SCREEN 1
+#include "arch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TABLESIZE 8192
+/* the top 3 bits of a row pick the segment, the low 13 bits the entry */
+#define TABLE_SEGMENT(row) ((row) >> 13)
+#define TABLE_INDEX(row) ((row) & (TABLESIZE - 1))
+
+/* lookups per pass, a row sequence that visits all 8 segments */
+#define BENCH_LOOKUPS 65536L
+#define BENCH_PASSES 64
+
+static row_t *row_table[8];
+static score_heur_t *score_heur_table[8];
+
+static void alloc_tables(void) {
+    int i = 0;
+
+    for (i = 0; i < 8; ++i) {
+        row_table[i] = (row_t *)malloc(sizeof(row_t) * TABLESIZE);
+        score_heur_table[i] = (score_heur_t *)malloc(sizeof(score_heur_t) * TABLESIZE);
+        if (!row_table[i] || !score_heur_table[i]) {
+            fprintf(stderr, "Not enough memory.");
+            fflush(stderr);
+            abort();
+        }
+    }
+}
+
+static void free_tables(void) {
+    int i = 0;
+
+    for (i = 0; i < 8; ++i) {
+        free(row_table[i]);
+        free(score_heur_table[i]);
+    }
+}
+
+static void init_tables(void) {
+    row_t row = 0;
+
+    do {
+        row_table[row / TABLESIZE][row % TABLESIZE] = (row_t)(row * 31);
+        score_heur_table[row / TABLESIZE][row % TABLESIZE] = (score_heur_t)(row & 0xff);
+    } while (row++ != 0xFFFF);
+}
+
+/* the lookups as 2048ai16 did them before, a divide and a modulo each */
+static score_heur_t bench_divide(unsigned long *sum) {
+    score_heur_t score_heur = 0.0f;
+    row_t row = 1;
+    long i = 0;
+
+    for (i = 0; i < BENCH_LOOKUPS; ++i) {
+        row = (row_t)(row * 25173U + 13849U);
+        *sum += row_table[row / TABLESIZE][row % TABLESIZE];
+        score_heur += score_heur_table[row / TABLESIZE][row % TABLESIZE];
+    }
+    return score_heur;
+}
+
+static score_heur_t bench_segment(unsigned long *sum) {
+    score_heur_t score_heur = 0.0f;
+    row_t row = 1;
+    long i = 0;
+
+    for (i = 0; i < BENCH_LOOKUPS; ++i) {
+        row = (row_t)(row * 25173U + 13849U);
+        *sum += row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
+        score_heur += score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
+    }
+    return score_heur;
+}
+
+static double bench(score_heur_t (*func)(unsigned long *), unsigned long *sum, score_heur_t *score_heur) {
+    clock_t start = clock();
+    int i = 0;
+
+    *sum = 0;
+    *score_heur = 0.0f;
+    for (i = 0; i < BENCH_PASSES; ++i) {
+        *score_heur += func(sum);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void) {
+    unsigned long sum_divide = 0, sum_segment = 0;
+    score_heur_t heur_divide = 0.0f, heur_segment = 0.0f;
+    double divide = 0.0, segment = 0.0;
+
+    alloc_tables();
+    init_tables();
+    divide = bench(bench_divide, &sum_divide, &heur_divide);
+    segment = bench(bench_segment, &sum_segment, &heur_segment);
+    free_tables();
+
+    if (sum_divide != sum_segment || heur_divide != heur_segment) {
+        printf("Lookups differ.\n");
+        return 1;
+    }
+    printf("%ld lookups in 8 segments of %d entries\n", BENCH_LOOKUPS * BENCH_PASSES, TABLESIZE);
+    printf("divide/modulo: %.3fs\n", divide);
+    printf("shift/mask:    %.3fs\n", segment);
+    if (segment > 0.0) {
+        printf("ratio:         %.2f\n", divide / segment);
+    }
+    return 0;
+}
@@ -47,6 +47,9 @@ typedef struct {
 } eval_state;
 
 #define TABLESIZE 8192
+/* the top 3 bits of a row pick the segment, the low 13 bits the entry */
+#define TABLE_SEGMENT(row) ((row) >> 13)
+#define TABLE_INDEX(row) ((row) & (TABLESIZE - 1))
 static score_heur_t *score_heur_table[8];
 
 static unsigned int unif_random(unsigned int n) {
@@ -191,7 +194,7 @@ static void init_tables(void) {
             }
         }
 
-        score_heur_table[row / TABLESIZE][row % TABLESIZE] =
+        score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] =
             (score_heur_t)(SCORE_LOST_PENALTY +
                            SCORE_EMPTY_WEIGHT * empty +
                            SCORE_MERGES_WEIGHT * merges -
@@ -310,7 +313,7 @@ static score_heur_t score_heur_helper(board_t board) {
 
     for (i = 0; i < 4; ++i) {
         row = ((row_t *)&board)[3 - i];
-        score_heur += score_heur_table[row / TABLESIZE][row % TABLESIZE];
+        score_heur += score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
     }
     return score_heur;
 }
@@ -54,6 +54,7 @@
 #include <string.h>
 #include <time.h>
 
+#ifndef NO_CLEAR_SCREEN
 static void clear_screen(void) {
 #if defined(_WIN32) && !defined(NOT_USE_WIN32_SDK)
     HANDLE hStdOut;
@@ -95,6 +96,7 @@ static void clear_screen(void) {
     system("cls");
 #endif
 }
+#endif
 
 #ifndef AI_SOURCE
 static int get_ch(void) {
@@ -167,13 +169,20 @@ typedef struct {
 typedef float score_heur_t;
 
 #ifdef AI_SOURCE
-#ifndef __16BIT__
-#if defined(_MSC_VER) && _MSC_VER >= 1500
+#if !defined(__16BIT__) && defined(_MSC_VER) && _MSC_VER >= 1500
 #include <intrin.h>
+#pragma intrinsic(_BitScanForward)
 #define popcount __popcnt
-#elif defined(__GNUC__) && (__GNUC__ >= 4 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+static __inline int ctz(unsigned int bitset) {
+    unsigned long index;
+    _BitScanForward(&index, bitset);
+    return (int)index;
+}
+#elif !defined(__16BIT__) && defined(__GNUC__) && (__GNUC__ >= 4 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
 #define popcount __builtin_popcount
-#else
+#define ctz __builtin_ctz
+#elif defined(AI_BITOPS)
+/* only in the sources that use them, other AI sources would get unused statics */
 static int popcount(unsigned int bitset) {
     int count = 0;
     while (bitset) {
@@ -182,7 +191,16 @@ static int popcount(unsigned int bitset) {
     }
     return count;
 }
-#endif
+
+/* bitset must not be 0 */
+static int ctz(unsigned int bitset) {
+    int count = 0;
+    while (!(bitset & 1)) {
+        bitset >>= 1;
+        count++;
+    }
+    return count;
+}
 #endif
 #endif
 
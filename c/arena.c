@@ -0,0 +1,100 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_DEFAULT_CHUNK 65536
+
+typedef struct arena_chunk_t arena_chunk_t;
+
+struct arena_chunk_t {
+    arena_chunk_t *next;
+    size_t size;
+    /* keeps the data that follows the header aligned */
+    union {
+        void *p;
+        double d;
+        long l;
+    } align;
+};
+
+static size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static char *arena_chunk_data(arena_chunk_t *chunk) {
+    return (char *)chunk + arena_round(sizeof(arena_chunk_t));
+}
+
+static void arena_enter(arena_t *arena, arena_chunk_t *chunk) {
+    arena->cur = chunk;
+    arena->ptr = arena_chunk_data(chunk);
+    arena->end = arena->ptr + chunk->size;
+}
+
+void arena_init(arena_t *arena, size_t chunk_size) {
+    arena->head = NULL;
+    arena->cur = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+    arena->chunk_size = chunk_size ? arena_round(chunk_size) : ARENA_DEFAULT_CHUNK;
+    arena->nallocs = 0;
+    arena->nmallocs = 0;
+}
+
+void arena_delete(arena_t *arena) {
+    arena_chunk_t *chunk = arena->head;
+
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->cur = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    void *ret = NULL;
+
+    size = arena_round(size);
+    if ((size_t)(arena->end - arena->ptr) < size) {
+        arena_chunk_t *chunk = arena->cur ? arena->cur->next : arena->head;
+
+        /* reuse chunks kept by arena_reset before asking malloc for a new one */
+        while (chunk && chunk->size < size) {
+            chunk = chunk->next;
+        }
+        if (!chunk) {
+            size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+
+            chunk = (arena_chunk_t *)malloc(arena_round(sizeof(arena_chunk_t)) + chunk_size);
+            if (!chunk) {
+                return NULL;
+            }
+            arena->nmallocs++;
+            chunk->size = chunk_size;
+            if (arena->cur) {
+                chunk->next = arena->cur->next;
+                arena->cur->next = chunk;
+            } else {
+                chunk->next = arena->head;
+                arena->head = chunk;
+            }
+        }
+        arena_enter(arena, chunk);
+    }
+    ret = arena->ptr;
+    arena->ptr += size;
+    arena->nallocs++;
+    return ret;
+}
+
+void arena_reset(arena_t *arena) {
+    arena->cur = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+}
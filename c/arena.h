@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct arena_chunk_t;
+
+/*
+ * Bump allocator: blocks are carved out of malloc'ed chunks and released all
+ * at once by arena_reset(), which keeps the chunks for the next round.
+ */
+typedef struct {
+    struct arena_chunk_t *head;
+    struct arena_chunk_t *cur;
+    char *ptr;
+    char *end;
+    size_t chunk_size;
+    size_t nallocs;             /* blocks handed out since arena_init */
+    size_t nmallocs;            /* malloc calls made for chunks since arena_init */
+} arena_t;
+
+extern void arena_init(arena_t *arena, size_t chunk_size);
+
+extern void arena_delete(arena_t *arena);
+
+extern void *arena_alloc(arena_t *arena, size_t size);
+
+extern void arena_reset(arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
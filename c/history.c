@@ -0,0 +1,355 @@
+#include "history.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if HISTORY_MMAP_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* spare entries of a new history, the file doubles when they run out */
+#define HISTORY_MIN_CAPACITY 256
+
+static const char history_magic[4] = { '2', 'K', 'H', 'S' };
+
+static void history_init(history_t *h) {
+    memset(h, 0x00, sizeof(*h));
+    h->header = &h->head;
+#if HISTORY_MMAP_WIN32
+    h->file = INVALID_HANDLE_VALUE;
+#elif HISTORY_MMAP_POSIX
+    h->fd = -1;
+#endif
+}
+
+static int history_valid(const history_header_t *header, unsigned long capacity) {
+    return memcmp(header->magic, history_magic, sizeof(history_magic)) == 0 && header->version == HISTORY_VERSION &&
+        header->bom == HISTORY_BOM && header->count >= 1 && header->count <= capacity && header->cursor < header->count;
+}
+
+#if HISTORY_MMAP_POSIX
+/*
+ * grows the file by writing zeros; ftruncate would leave a hole, and a store
+ * to a page of it that the disk has no room for raises SIGBUS instead of
+ * failing here
+ */
+static int history_extend(int fd, size_t from, size_t size) {
+    static const char zeros[512] = { 0 };
+
+    while (from < size) {
+        size_t n = size - from < sizeof(zeros) ? size - from : sizeof(zeros);
+        ssize_t written = pwrite(fd, zeros, n, (off_t)from);
+
+        if (written <= 0) {
+            return 0;
+        }
+        from += (size_t)written;
+    }
+    return 1;
+}
+#endif
+
+#if HISTORY_MMAP_WIN32 || HISTORY_MMAP_POSIX
+/* maps capacity entries, growing the file when it is shorter */
+static int history_map(history_t *h, unsigned long capacity) {
+    size_t size = sizeof(history_header_t) + capacity * sizeof(history_entry_t);
+#if HISTORY_MMAP_POSIX
+    struct stat st;
+    void *p = MAP_FAILED;
+
+    if (fstat(h->fd, &st) != 0 || ((size_t)st.st_size < size && !history_extend(h->fd, (size_t)st.st_size, size))) {
+        return 0;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, h->fd, 0);
+    if (p == MAP_FAILED) {
+        return 0;
+    }
+#else
+    /* the mapping grows the file and allocates its clusters, a full disk fails here */
+    HANDLE mapping = CreateFileMappingA(h->file, NULL, PAGE_READWRITE, 0, (DWORD)size, NULL);
+    void *p = NULL;
+
+    if (mapping) {
+        p = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+        CloseHandle(mapping);
+    }
+    if (!p) {
+        return 0;
+    }
+#endif
+    h->base = (char *)p;
+    h->size = size;
+    h->capacity = capacity;
+    h->header = (history_header_t *)h->base;
+    h->entries = (history_entry_t *)(h->base + sizeof(history_header_t));
+    return 1;
+}
+
+static void history_unmap_view(char *base, size_t size) {
+#if HISTORY_MMAP_POSIX
+    munmap(base, size);
+#else
+    (void)size;
+    UnmapViewOfFile(base);
+#endif
+}
+
+static void history_unmap(history_t *h) {
+    if (h->base) {
+        history_unmap_view(h->base, h->size);
+        h->base = NULL;
+    }
+}
+
+static void history_close_file(history_t *h) {
+#if HISTORY_MMAP_WIN32
+    if (h->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(h->file);
+        h->file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (h->fd >= 0) {
+        close(h->fd);
+        h->fd = -1;
+    }
+#endif
+}
+
+/* 1 when mapped, 0 when the file cannot be mapped, -1 when it is not a history */
+static int history_open_mapped(history_t *h, const char *path, board_t board) {
+    size_t size = 0;
+    unsigned long capacity = HISTORY_MIN_CAPACITY;
+
+#if HISTORY_MMAP_POSIX
+    struct stat st;
+
+    h->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (h->fd < 0 || fstat(h->fd, &st) != 0) {
+        return 0;
+    }
+    size = (size_t)st.st_size;
+#else
+    DWORD high = 0, low = 0;
+
+    h->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h->file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    low = GetFileSize(h->file, &high);
+    if (low == INVALID_FILE_SIZE || high != 0) {
+        return 0;
+    }
+    size = (size_t)low;
+#endif
+    if (size == 0) {
+        return history_map(h, capacity) && history_reset(h, board) ? 1 : 0;
+    }
+    if (size < sizeof(history_header_t) + sizeof(history_entry_t)) {
+        return -1;
+    }
+    capacity = (unsigned long)((size - sizeof(history_header_t)) / sizeof(history_entry_t));
+    if (!history_map(h, capacity)) {
+        return 0;
+    }
+    return history_valid(h->header, h->capacity) ? 1 : -1;
+}
+#endif
+
+/* the header and count entries from first, only the header for count 0 */
+static int history_sync(history_t *h, unsigned long first, unsigned long count) {
+    int ret = 1;
+
+    if (h->base || !h->fp) {
+        return 1;
+    }
+    ret = fseek(h->fp, 0, SEEK_SET) == 0 && fwrite(h->header, sizeof(history_header_t), 1, h->fp) == 1;
+    if (ret && count > 0) {
+        ret = fseek(h->fp, (long)(sizeof(history_header_t) + first * sizeof(history_entry_t)), SEEK_SET) == 0 &&
+            fwrite(&h->entries[first], sizeof(history_entry_t), count, h->fp) == count;
+    }
+    return fflush(h->fp) == 0 && ret;
+}
+
+static int history_reserve(history_t *h, unsigned long count) {
+    unsigned long capacity = h->capacity ? h->capacity : HISTORY_MIN_CAPACITY;
+
+    if (count <= h->capacity) {
+        return 1;
+    }
+    if (count > HISTORY_MAX_CAPACITY) {
+        return 0;
+    }
+    while (capacity < count) {
+        capacity = capacity > HISTORY_MAX_CAPACITY / 2 ? HISTORY_MAX_CAPACITY : capacity * 2;
+    }
+#if HISTORY_MMAP_WIN32 || HISTORY_MMAP_POSIX
+    if (h->base) {
+        char *base = h->base;
+        size_t size = h->size;
+
+        /* the old view stays in use when the larger one cannot be mapped */
+        if (!history_map(h, capacity)) {
+            return 0;
+        }
+        history_unmap_view(base, size);
+        return 1;
+    }
+#endif
+    {
+        history_entry_t *entries = (history_entry_t *)realloc(h->entries, capacity * sizeof(history_entry_t));
+
+        if (!entries) {
+            return 0;
+        }
+        h->entries = entries;
+        h->capacity = capacity;
+    }
+    return 1;
+}
+
+static int history_open_file(history_t *h, const char *path, board_t board) {
+    h->fp = fopen(path, "r+b");
+    if (!h->fp) {
+        h->fp = fopen(path, "w+b");
+        return h->fp && history_reset(h, board);
+    }
+    if (fread(&h->head, sizeof(history_header_t), 1, h->fp) != 1) {
+        /* an empty file is a new history, as is a missing one */
+        return feof(h->fp) && ftell(h->fp) == 0 && history_reset(h, board);
+    }
+    if (!history_valid(&h->head, h->head.count) ||
+        !history_reserve(h, h->head.count) ||
+        fread(h->entries, sizeof(history_entry_t), h->head.count, h->fp) != h->head.count) {
+        return 0;
+    }
+    return 1;
+}
+
+int history_open(history_t *h, const char *path, board_t board) {
+    int ret = 0;
+
+    history_init(h);
+    if (!path) {
+        return history_reset(h, board);
+    }
+#if HISTORY_MMAP_WIN32 || HISTORY_MMAP_POSIX
+    ret = history_open_mapped(h, path, board);
+    if (ret != 0) {
+        if (ret < 0) {
+            history_close(h);
+        }
+        return ret > 0;
+    }
+    history_close(h);
+    history_init(h);
+#endif
+    ret = history_open_file(h, path, board);
+    if (!ret) {
+        history_close(h);
+    }
+    return ret;
+}
+
+int history_reset(history_t *h, board_t board) {
+    if (!history_reserve(h, 1)) {
+        return 0;
+    }
+    memcpy(h->header->magic, history_magic, sizeof(history_magic));
+    h->header->version = HISTORY_VERSION;
+    h->header->bom = HISTORY_BOM;
+    h->header->count = 1;
+    h->header->cursor = 0;
+    h->header->dropped = 0;
+    h->entries[0].board = board;
+    h->entries[0].penalty = 0;
+    h->entries[0].reserved = 0;
+    return history_sync(h, 0, 1);
+}
+
+/* keeps the newer half of the positions before next, returns the new next */
+static unsigned long history_drop(history_t *h, unsigned long next) {
+    unsigned long drop = next / 2;
+
+    memmove(h->entries, h->entries + drop, (next - drop) * sizeof(history_entry_t));
+    h->header->dropped += (history_word_t)drop;
+    return next - drop;
+}
+
+int history_push(history_t *h, board_t board, unsigned long penalty) {
+    unsigned long next = (unsigned long)h->header->cursor + 1, first = next;
+
+    if (next >= HISTORY_MAX_CAPACITY) {
+        next = history_drop(h, next);
+        first = 0;
+    }
+    if (!history_reserve(h, next + 1)) {
+        /* a file that cannot grow is an error, memory that cannot grow is full */
+        if (h->base || next < 2) {
+            return 0;
+        }
+        next = history_drop(h, next);
+        first = 0;
+    }
+    h->entries[next].board = board;
+    h->entries[next].penalty = (history_word_t)penalty;
+    h->entries[next].reserved = 0;
+    h->header->count = (history_word_t)(next + 1);
+    h->header->cursor = (history_word_t)next;
+    return history_sync(h, first, next + 1 - first);
+}
+
+int history_undo(history_t *h) {
+    if (h->header->cursor == 0) {
+        return 0;
+    }
+    h->header->cursor--;
+    return history_sync(h, 0, 0);
+}
+
+int history_redo(history_t *h) {
+    if (h->header->cursor + 1 >= h->header->count) {
+        return 0;
+    }
+    h->header->cursor++;
+    return history_sync(h, 0, 0);
+}
+
+int history_detach(history_t *h) {
+#if HISTORY_MMAP_WIN32 || HISTORY_MMAP_POSIX
+    if (h->base) {
+        history_entry_t *entries = (history_entry_t *)malloc(h->capacity * sizeof(history_entry_t));
+
+        if (!entries) {
+            return 0;
+        }
+        memcpy(entries, h->entries, h->header->count * sizeof(history_entry_t));
+        h->head = *h->header;
+        history_unmap(h);
+        h->header = &h->head;
+        h->entries = entries;
+    }
+    history_close_file(h);
+#endif
+    if (h->fp) {
+        fclose(h->fp);
+        h->fp = NULL;
+    }
+    return 1;
+}
+
+void history_close(history_t *h) {
+#if HISTORY_MMAP_WIN32 || HISTORY_MMAP_POSIX
+    if (h->base) {
+        history_unmap(h);
+        h->entries = NULL;
+    }
+    history_close_file(h);
+#endif
+    free(h->entries);
+    if (h->fp) {
+        fclose(h->fp);
+    }
+    history_init(h);
+}
@@ -0,0 +1,116 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Undo/redo history of one game, kept in a file so that a game can be
+ * resumed (include arch.h with SUPPORT_64BIT first). Native byte order so
+ * that the file can be mapped as is:
+ *   header   "2KHS", version, byte order mark 0x01020304, number of
+ *            positions, current position, moves made before the first
+ *            position (4 bytes each)
+ *   entries  one per position, the first is the initial board unless older
+ *            positions were dropped: board (8 bytes), score penalty of the
+ *            4-tiles so far (4 bytes), zero (4 bytes)
+ * The file may be longer than the positions it holds, spare entries follow.
+ * Positions are appended after the current one; a move made after undo
+ * replaces the positions that could have been redone. A history keeps at
+ * most HISTORY_MAX_CAPACITY positions, the older half is dropped when it is
+ * full, and also when the entries are in memory and cannot grow.
+ */
+#define HISTORY_VERSION 1
+#define HISTORY_BOM 0x01020304UL
+
+#if defined(_WIN32) && !defined(NOT_USE_WIN32_SDK)
+#define HISTORY_MMAP_WIN32 1
+#elif defined(UNIX_LIKE)
+#define HISTORY_MMAP_POSIX 1
+#endif
+
+#ifndef HISTORY_MAX_CAPACITY
+#ifdef __16BIT__
+/* 8KiB of entries, the near heap of the tiny and small models is shared with everything else */
+#define HISTORY_MAX_CAPACITY 512UL
+#else
+/* the entries are one allocation, its size has to fit in size_t */
+#define HISTORY_MAX_CAPACITY ((unsigned long)(((size_t)-1 - sizeof(history_header_t)) / sizeof(history_entry_t)))
+#endif
+#endif
+
+#if ULONG_MAX == 0xFFFFFFFFUL
+typedef unsigned long history_word_t;
+#else
+typedef unsigned int history_word_t;
+#endif
+
+typedef struct {
+    char magic[4];
+    history_word_t version;
+    history_word_t bom;
+    history_word_t count;
+    history_word_t cursor;
+    history_word_t dropped;
+} history_header_t;
+
+typedef struct {
+    board_t board;
+    history_word_t penalty;
+    history_word_t reserved;
+} history_entry_t;
+
+typedef struct {
+    history_header_t *header;   /* in the mapping, or head below */
+    history_entry_t *entries;
+    unsigned long capacity;
+    char *base;                 /* file mapping, NULL when entries are malloc'ed */
+    size_t size;
+    FILE *fp;                   /* written through when not mapped, NULL for no file */
+    history_header_t head;
+#if HISTORY_MMAP_WIN32
+    HANDLE file;
+#elif HISTORY_MMAP_POSIX
+    int fd;
+#endif
+} history_t;
+
+/*
+ * resumes the history in path, or starts one with board, keeping it in
+ * memory only when path is NULL; returns 0 on I/O errors and for files
+ * that are not a history
+ */
+extern int history_open(history_t *h, const char *path, board_t board);
+
+/* position after the current one, the positions that could be redone are dropped */
+extern int history_push(history_t *h, board_t board, unsigned long penalty);
+
+/* both return 0 when there is no position to go to */
+extern int history_undo(history_t *h);
+extern int history_redo(history_t *h);
+
+/* starts over with board as the only position */
+extern int history_reset(history_t *h, board_t board);
+
+/*
+ * closes the file and keeps the positions in memory only, for going on after
+ * a write error; returns 0 when there is not enough memory
+ */
+extern int history_detach(history_t *h);
+
+#define history_board(h) ((h)->entries[(h)->header->cursor].board)
+#define history_penalty(h) ((unsigned long)(h)->entries[(h)->header->cursor].penalty)
+/* moves made to reach the current position */
+#define history_moves(h) ((unsigned long)(h)->header->dropped + (unsigned long)(h)->header->cursor)
+
+extern void history_close(history_t *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+#include "imap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAP_MIN_CAPACITY 16
+/* old slots moved per insert while growing, enough to finish before the next grow */
+#define IMAP_MIGRATE_STEP 8
+/* clear halves a table while its entries fill less than 1/8 of it */
+#define IMAP_SHRINK_LOAD 8
+
+/* murmur3 finalizer, every key bit affects the low bits used as index */
+static size_t imap_index(board_t key, size_t capacity) {
+    key ^= key >> 33;
+    key *= W64LIT(0xFF51AFD7ED558CCD);
+    key ^= key >> 33;
+    key *= W64LIT(0xC4CEB9FE1A85EC53);
+    key ^= key >> 33;
+    return (size_t)key & (capacity - 1);
+}
+
+static char *imap_find(char *slots, size_t capacity, size_t stride, board_t key) {
+    size_t i = imap_index(key, capacity);
+
+    while (1) {
+        char *slot = slots + i * stride;
+        board_t cur = *(board_t *)slot;
+
+        if (cur == key) {
+            return slot;
+        }
+        if (cur == 0) {
+            return NULL;
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+}
+
+static void imap_insert(char *slots, size_t capacity, size_t stride, const char *from) {
+    size_t i = imap_index(*(const board_t *)from, capacity);
+
+    while (*(board_t *)(slots + i * stride) != 0) {
+        i = (i + 1) & (capacity - 1);
+    }
+    memcpy(slots + i * stride, from, stride);
+}
+
+static void imap_migrate(imap_base_t *base, size_t count) {
+    size_t end = base->migrate_pos + count;
+
+    if (end > base->old_capacity) {
+        end = base->old_capacity;
+    }
+    while (base->migrate_pos < end) {
+        const char *slot = base->old_slots + base->migrate_pos * base->stride;
+
+        if (*(const board_t *)slot != 0) {
+            imap_insert(base->slots, base->capacity, base->stride, slot);
+        }
+        base->migrate_pos++;
+    }
+    if (base->migrate_pos == base->old_capacity) {
+        free(base->old_slots);
+        base->old_slots = NULL;
+        base->old_capacity = 0;
+        base->migrate_pos = 0;
+    }
+}
+
+static int imap_grow(imap_base_t *base) {
+    size_t capacity = base->capacity ? base->capacity * 2 : IMAP_MIN_CAPACITY;
+    char *slots = NULL;
+
+    if (base->old_slots) {
+        imap_migrate(base, base->old_capacity);
+    }
+    if (capacity < base->capacity || capacity >= ((size_t)-1) / base->stride) {
+        return 0;
+    }
+    /* calloc lets big tables come zeroed from the OS instead of a memset here */
+    slots = (char *)calloc(capacity + 1, base->stride);
+    if (!slots) {
+        return 0;
+    }
+    if (base->slots) {
+        /* key 0 lives in the extra slot past the table */
+        memcpy(slots + capacity * base->stride, base->slots + base->capacity * base->stride, base->stride);
+    }
+    base->old_slots = base->slots;
+    base->old_capacity = base->capacity;
+    base->migrate_pos = 0;
+    base->slots = slots;
+    base->capacity = capacity;
+    if (!base->old_slots) {
+        base->old_capacity = 0;
+    }
+    return 1;
+}
+
+void imap_init_(imap_base_t *base, size_t vsize) {
+    base->slots = NULL;
+    base->old_slots = NULL;
+    base->capacity = 0;
+    base->old_capacity = 0;
+    base->migrate_pos = 0;
+    base->nnodes = 0;
+    base->vsize = vsize;
+    base->stride = sizeof(board_t) + (vsize + sizeof(board_t) - 1) / sizeof(board_t) * sizeof(board_t);
+    base->has_zero = 0;
+}
+
+void imap_delete_(imap_base_t *base) {
+    free(base->slots);
+    free(base->old_slots);
+    imap_init_(base, base->vsize);
+}
+
+/*
+ * Wiping costs the whole table, so a table left mostly empty by its last use
+ * is replaced by one sized for that use; repeated clears then cost about as
+ * much as the inserts between them. A generation tag per slot would avoid the
+ * wipe, but grows every slot by a word on the probe path.
+ */
+void imap_clear_(imap_base_t *base) {
+    size_t capacity = base->capacity;
+
+    free(base->old_slots);
+    base->old_slots = NULL;
+    base->old_capacity = 0;
+    base->migrate_pos = 0;
+    if (base->slots) {
+        char *slots = NULL;
+
+        while (capacity > IMAP_MIN_CAPACITY && base->nnodes * IMAP_SHRINK_LOAD < capacity) {
+            capacity /= 2;
+        }
+        if (capacity < base->capacity) {
+            slots = (char *)calloc(capacity + 1, base->stride);
+        }
+        if (slots) {
+            free(base->slots);
+            base->slots = slots;
+            base->capacity = capacity;
+        } else {
+            memset(base->slots, 0x00, (base->capacity + 1) * base->stride);
+        }
+    }
+    base->nnodes = 0;
+    base->has_zero = 0;
+}
+
+void *imap_get_(imap_base_t *base, board_t key) {
+    char *slot = NULL;
+
+    if (!base->slots) {
+        return NULL;
+    }
+    if (key == 0) {
+        return base->has_zero ? base->slots + base->capacity * base->stride + sizeof(board_t) : NULL;
+    }
+    slot = imap_find(base->slots, base->capacity, base->stride, key);
+    if (!slot && base->old_slots) {
+        slot = imap_find(base->old_slots, base->old_capacity, base->stride, key);
+    }
+    return slot ? slot + sizeof(board_t) : NULL;
+}
+
+int imap_set_(imap_base_t *base, board_t key, const void *value) {
+    char *slot = NULL;
+
+    if (base->slots) {
+        if (key == 0) {
+            slot = base->slots + base->capacity * base->stride;
+            if (!base->has_zero) {
+                base->has_zero = 1;
+                base->nnodes++;
+            }
+            memcpy(slot + sizeof(board_t), value, base->vsize);
+            return 1;
+        }
+        slot = imap_find(base->slots, base->capacity, base->stride, key);
+        if (!slot && base->old_slots) {
+            /* not moved yet, update in place and let the migration carry it over */
+            slot = imap_find(base->old_slots, base->old_capacity, base->stride, key);
+        }
+        if (slot) {
+            memcpy(slot + sizeof(board_t), value, base->vsize);
+            return 1;
+        }
+    }
+    /* keep the load factor at or below 1/2 */
+    if ((base->nnodes + 1) * 2 > base->capacity && !imap_grow(base)) {
+        return 0;
+    }
+    if (key == 0) {
+        return imap_set_(base, key, value);
+    }
+    slot = base->slots + imap_index(key, base->capacity) * base->stride;
+    while (*(board_t *)slot != 0) {
+        slot += base->stride;
+        if (slot == base->slots + base->capacity * base->stride) {
+            slot = base->slots;
+        }
+    }
+    *(board_t *)slot = key;
+    memcpy(slot + sizeof(board_t), value, base->vsize);
+    base->nnodes++;
+    if (base->old_slots) {
+        imap_migrate(base, IMAP_MIGRATE_STEP);
+    }
+    return 1;
+}
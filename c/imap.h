@@ -0,0 +1,64 @@
+#ifndef IMAP_H
+#define IMAP_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hash map from board_t (a 64-bit integer, include arch.h with SUPPORT_64BIT
+ * first) to a fixed-size value. Keys and values are stored inline in one
+ * open addressing table with linear probing. Growing doubles the table, then
+ * moves the old slots over a few at a time on later inserts, so no single
+ * insert pays for a full rehash. There is no remove.
+ */
+typedef struct {
+    char *slots;                /* capacity slots, plus one for key 0 */
+    char *old_slots;            /* table being migrated, NULL when idle */
+    size_t capacity;
+    size_t old_capacity;
+    size_t migrate_pos;         /* old slots below this are already moved */
+    size_t nnodes;
+    size_t vsize;
+    size_t stride;
+    int has_zero;
+} imap_base_t;
+
+#define imap_t(VT)             \
+    struct {                   \
+        imap_base_t base;      \
+        VT tmpval;             \
+    }
+
+#define imap_init(m) imap_init_(&(m)->base, sizeof((m)->tmpval))
+
+#define imap_delete(m) imap_delete_(&(m)->base)
+
+/* remove all entries, a table that was mostly empty is shrunk */
+#define imap_clear(m) imap_clear_(&(m)->base)
+
+#define imap_get(m, key) imap_get_(&(m)->base, key)
+
+/* returns 0 when the table cannot grow, the entry is then dropped */
+#define imap_set(m, key, value) ((m)->tmpval = (value), imap_set_(&(m)->base, key, &(m)->tmpval))
+
+#define imap_size(m) ((m)->base.nnodes)
+
+/* private function */
+extern void imap_init_(imap_base_t *base, size_t vsize);
+
+extern void imap_delete_(imap_base_t *base);
+
+extern void imap_clear_(imap_base_t *base);
+
+extern void *imap_get_(imap_base_t *base, board_t key);
+
+extern int imap_set_(imap_base_t *base, board_t key, const void *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
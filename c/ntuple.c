@@ -0,0 +1,337 @@
+#include "ntuple.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) && !defined(NOT_USE_WIN32_SDK)
+#define NTUPLE_MMAP_WIN32 1
+#elif defined(UNIX_LIKE)
+#define NTUPLE_MMAP_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char ntuple_magic[4] = { '2', 'K', 'N', 'T' };
+
+static size_t ntuple_align(size_t offset) {
+    return (offset + NTUPLE_ALIGN - 1) / NTUPLE_ALIGN * NTUPLE_ALIGN;
+}
+
+/* file size for the tuples in net, and the table pointers when base is set */
+static size_t ntuple_layout(ntuple_net_t *net) {
+    size_t offset = ntuple_align(NTUPLE_HEADER_SIZE);
+    int i;
+
+    for (i = 0; i < net->ntuples; ++i) {
+        if (net->base) {
+            net->tuples[i].weights = (float *)(net->base + offset);
+        }
+        offset = ntuple_align(offset + ((size_t)1 << (net->tuples[i].ncells << 2)) * sizeof(float));
+    }
+    return offset;
+}
+
+static void ntuple_write_header(const ntuple_net_t *net, char *header) {
+    unsigned long words[3];
+    int i, j;
+
+    memset(header, 0x00, NTUPLE_HEADER_SIZE);
+    memcpy(header, ntuple_magic, sizeof(ntuple_magic));
+    words[0] = NTUPLE_VERSION;
+    words[1] = NTUPLE_BOM;
+    words[2] = (unsigned long)net->ntuples;
+    for (i = 0; i < 3; ++i) {
+        unsigned int word = (unsigned int)words[i];
+
+        memcpy(header + 4 + i * 4, &word, 4);
+    }
+    for (i = 0; i < net->ntuples; ++i) {
+        header[16 + i * 8] = (char)net->tuples[i].ncells;
+        for (j = 0; j < net->tuples[i].ncells; ++j) {
+            header[17 + i * 8 + j] = (char)net->tuples[i].cells[j];
+        }
+    }
+}
+
+static int ntuple_read_header(ntuple_net_t *net, const char *data, size_t size) {
+    unsigned int words[3];
+    int i, j;
+
+    if (size < NTUPLE_HEADER_SIZE || memcmp(data, ntuple_magic, sizeof(ntuple_magic)) != 0) {
+        return 0;
+    }
+    memcpy(words, data + 4, sizeof(words));
+    if (words[0] != NTUPLE_VERSION || words[1] != NTUPLE_BOM || words[2] == 0 || words[2] > NTUPLE_MAX_TUPLES) {
+        return 0;
+    }
+    net->ntuples = (int)words[2];
+    for (i = 0; i < net->ntuples; ++i) {
+        unsigned int used = 0;
+        ntuple_t *tuple = &net->tuples[i];
+
+        tuple->ncells = (unsigned char)data[16 + i * 8];
+        if (tuple->ncells < 1 || tuple->ncells > NTUPLE_MAX_CELLS) {
+            return 0;
+        }
+        for (j = 0; j < tuple->ncells; ++j) {
+            tuple->cells[j] = (unsigned char)data[17 + i * 8 + j];
+            if (tuple->cells[j] >= 16 || (used & (1u << tuple->cells[j]))) {
+                return 0;
+            }
+            used |= 1u << tuple->cells[j];
+        }
+    }
+    return 1;
+}
+
+static void ntuple_reset(ntuple_net_t *net) {
+    memset(net, 0x00, sizeof(*net));
+}
+
+int ntuple_create(ntuple_net_t *net, int ntuples, const signed char (*shapes)[NTUPLE_MAX_CELLS + 1]) {
+    int i, j;
+
+    ntuple_reset(net);
+    if (ntuples < 1 || ntuples > NTUPLE_MAX_TUPLES) {
+        return 0;
+    }
+    net->ntuples = ntuples;
+    for (i = 0; i < ntuples; ++i) {
+        for (j = 0; j < NTUPLE_MAX_CELLS && shapes[i][j] >= 0; ++j) {
+            net->tuples[i].cells[j] = (unsigned char)shapes[i][j];
+        }
+        net->tuples[i].ncells = j;
+    }
+    net->size = ntuple_layout(net);
+    net->base = (char *)calloc(net->size, 1);
+    if (!net->base) {
+        ntuple_reset(net);
+        return 0;
+    }
+    /* reading the header back validates the shapes */
+    ntuple_write_header(net, net->base);
+    if (!ntuple_read_header(net, net->base, net->size)) {
+        ntuple_free(net);
+        return 0;
+    }
+    ntuple_layout(net);
+    return 1;
+}
+
+int ntuple_copy(ntuple_net_t *net, const ntuple_net_t *from) {
+    ntuple_reset(net);
+    net->base = (char *)malloc(from->size);
+    if (!net->base) {
+        return 0;
+    }
+    memcpy(net->base, from->base, from->size);
+    net->size = from->size;
+    net->ntuples = from->ntuples;
+    memcpy(net->tuples, from->tuples, sizeof(net->tuples));
+    ntuple_layout(net);
+    return 1;
+}
+
+/* private copy-on-write mapping of the whole file, NULL when not supported */
+static char *ntuple_map(const char *path, size_t *size) {
+#if NTUPLE_MMAP_POSIX
+    struct stat st;
+    void *p = MAP_FAILED;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = (size_t)st.st_size;
+        p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return p == MAP_FAILED ? NULL : (char *)p;
+#elif NTUPLE_MMAP_WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping = NULL;
+    DWORD high = 0, low = 0;
+    void *p = NULL;
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    low = GetFileSize(file, &high);
+    if (low != INVALID_FILE_SIZE && high == 0 && low > 0) {
+        *size = (size_t)low;
+        mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    }
+    if (mapping) {
+        p = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return (char *)p;
+#else
+    return NULL;
+#endif
+}
+
+static void ntuple_unmap(char *base, size_t size) {
+#if NTUPLE_MMAP_POSIX
+    munmap(base, size);
+#elif NTUPLE_MMAP_WIN32
+    UnmapViewOfFile(base);
+#endif
+}
+
+static char *ntuple_read(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    char *data = NULL;
+    long len = -1;
+
+    if (!fp) {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        len = ftell(fp);
+    }
+    if (len > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        data = (char *)malloc((size_t)len);
+        if (data && fread(data, 1, (size_t)len, fp) != (size_t)len) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(fp);
+    *size = data ? (size_t)len : 0;
+    return data;
+}
+
+int ntuple_load(ntuple_net_t *net, const char *path) {
+    ntuple_reset(net);
+    net->base = ntuple_map(path, &net->size);
+    if (net->base) {
+        net->mapped = 1;
+    } else {
+        net->base = ntuple_read(path, &net->size);
+    }
+    if (!net->base) {
+        ntuple_reset(net);
+        return 0;
+    }
+    if (!ntuple_read_header(net, net->base, net->size) || ntuple_layout(net) != net->size) {
+        ntuple_free(net);
+        return 0;
+    }
+    return 1;
+}
+
+int ntuple_save(const ntuple_net_t *net, const char *path) {
+    char header[NTUPLE_HEADER_SIZE];
+    static const char zeros[NTUPLE_ALIGN] = { 0 };
+    size_t offset = 0;
+    int i, ret = 1;
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp) {
+        return 0;
+    }
+    ntuple_write_header(net, header);
+    ret = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+    offset = sizeof(header);
+    for (i = 0; i < net->ntuples && ret; ++i) {
+        size_t count = (size_t)1 << (net->tuples[i].ncells << 2);
+        size_t pad = ntuple_align(offset) - offset;
+
+        ret = fwrite(zeros, 1, pad, fp) == pad && fwrite(net->tuples[i].weights, sizeof(float), count, fp) == count;
+        offset += pad + count * sizeof(float);
+    }
+    if (ret) {
+        size_t pad = ntuple_align(offset) - offset;
+
+        ret = fwrite(zeros, 1, pad, fp) == pad;
+    }
+    if (fclose(fp) != 0) {
+        ret = 0;
+    }
+    return ret;
+}
+
+void ntuple_free(ntuple_net_t *net) {
+    if (net->base) {
+        if (net->mapped) {
+            ntuple_unmap(net->base, net->size);
+        } else {
+            free(net->base);
+        }
+    }
+    ntuple_reset(net);
+}
+
+void ntuple_symmetries(board_t board, board_t *sym) {
+    board_t a1 = board & W64LIT(0xF0F00F0FF0F00F0F);
+    board_t a2 = board & W64LIT(0x0000F0F00000F0F0);
+    board_t a3 = board & W64LIT(0x0F0F00000F0F0000);
+    board_t a = a1 | (a2 << 12) | (a3 >> 12);
+    board_t b1 = a & W64LIT(0xFF00FF0000FF00FF);
+    board_t b2 = a & W64LIT(0x00FF00FF00000000);
+    board_t b3 = a & W64LIT(0x00000000FF00FF00);
+    int i;
+
+    sym[0] = board;
+    sym[4] = b1 | (b2 >> 24) | (b3 << 24);
+    /* mirror left-right, then up-down, of the board and its transpose */
+    for (i = 0; i < 8; i += 4) {
+        board_t x = sym[i];
+
+        sym[i + 1] = ((x >> 12) & W64LIT(0x000F000F000F000F)) | ((x >> 4) & W64LIT(0x00F000F000F000F0)) |
+            ((x << 4) & W64LIT(0x0F000F000F000F00)) | ((x << 12) & W64LIT(0xF000F000F000F000));
+        sym[i + 2] = (x >> 48) | ((x >> 16) & W64LIT(0x00000000FFFF0000)) | ((x << 16) & W64LIT(0x0000FFFF00000000)) | (x << 48);
+        x = sym[i + 1];
+        sym[i + 3] = (x >> 48) | ((x >> 16) & W64LIT(0x00000000FFFF0000)) | ((x << 16) & W64LIT(0x0000FFFF00000000)) | (x << 48);
+    }
+}
+
+/* table indices of tuple in the 8 symmetric boards, independent of each other so the loops vectorize */
+static void ntuple_indices(const ntuple_t *tuple, const board_t *sym, unsigned int *index) {
+    int j, k;
+
+    for (k = 0; k < 8; ++k) {
+        index[k] = 0;
+    }
+    for (j = 0; j < tuple->ncells; ++j) {
+        int shift = tuple->cells[j] << 2;
+
+        for (k = 0; k < 8; ++k) {
+            index[k] |= (unsigned int)((sym[k] >> shift) & 0xf) << (j << 2);
+        }
+    }
+}
+
+float ntuple_value(const ntuple_net_t *net, board_t board) {
+    board_t sym[8];
+    unsigned int index[8];
+    float sum = 0.0f;
+    int i, k;
+
+    ntuple_symmetries(board, sym);
+    for (i = 0; i < net->ntuples; ++i) {
+        ntuple_indices(&net->tuples[i], sym, index);
+        for (k = 0; k < 8; ++k) {
+            sum += net->tuples[i].weights[index[k]];
+        }
+    }
+    return sum;
+}
+
+void ntuple_update(ntuple_net_t *net, board_t board, float delta) {
+    board_t sym[8];
+    unsigned int index[8];
+    int i, k;
+
+    ntuple_symmetries(board, sym);
+    for (i = 0; i < net->ntuples; ++i) {
+        ntuple_indices(&net->tuples[i], sym, index);
+        for (k = 0; k < 8; ++k) {
+            net->tuples[i].weights[index[k]] += delta;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef NTUPLE_H
+#define NTUPLE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * n-tuple network: each tuple is a set of cells, the ranks of those cells
+ * index a float table, and the value of a board is the sum over all tuples
+ * and all 8 symmetries of the board (include arch.h with SUPPORT_64BIT first).
+ *
+ * Weights file, native byte order so that it can be mapped as is:
+ *   header   "2KNT", version (4 bytes), byte order mark 0x01020304 (4 bytes),
+ *            number of tuples (4 bytes), then NTUPLE_MAX_TUPLES descriptors of
+ *            8 bytes: number of cells, cells, zero padding
+ *   tables   one float table of 16^cells entries per tuple, in tuple order,
+ *            each starting on a NTUPLE_ALIGN byte boundary
+ */
+#define NTUPLE_VERSION 1
+#define NTUPLE_BOM 0x01020304UL
+#define NTUPLE_MAX_TUPLES 16
+#define NTUPLE_MAX_CELLS 6
+#define NTUPLE_HEADER_SIZE (16 + NTUPLE_MAX_TUPLES * 8)
+#define NTUPLE_ALIGN 64
+
+typedef struct {
+    int ncells;
+    unsigned char cells[NTUPLE_MAX_CELLS];
+    float *weights;             /* 16^ncells entries */
+} ntuple_t;
+
+typedef struct {
+    int ntuples;
+    ntuple_t tuples[NTUPLE_MAX_TUPLES];
+    char *base;                 /* file image, header included */
+    size_t size;
+    int mapped;                 /* base is a private file mapping, not malloc'ed */
+} ntuple_net_t;
+
+/* zeroed weights for the given tuples, each a list of cells ended by -1 */
+extern int ntuple_create(ntuple_net_t *net, int ntuples, const signed char (*shapes)[NTUPLE_MAX_CELLS + 1]);
+
+/* maps the file copy-on-write where possible, returns 0 when it is not a valid weights file */
+extern int ntuple_load(ntuple_net_t *net, const char *path);
+
+/* malloc'ed copy, independent of the file from is mapped from */
+extern int ntuple_copy(ntuple_net_t *net, const ntuple_net_t *from);
+
+extern int ntuple_save(const ntuple_net_t *net, const char *path);
+
+extern void ntuple_free(ntuple_net_t *net);
+
+/* the 8 reflections and rotations of board */
+extern void ntuple_symmetries(board_t board, board_t *sym);
+
+extern float ntuple_value(const ntuple_net_t *net, board_t board);
+
+/*
+ * adds delta to every weight read by ntuple_value(net, board), without
+ * locks: concurrent updates of one weight may lose one of them (hogwild)
+ */
+extern void ntuple_update(ntuple_net_t *net, board_t board, float delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
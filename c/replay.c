@@ -0,0 +1,107 @@
+#include "replay.h"
+
+#include <string.h>
+
+static const char replay_magic[4] = { '2', 'K', 'R', 'P' };
+
+static void replay_put32(unsigned char *p, unsigned long value) {
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        p[i] = (unsigned char)(value >> (i << 3));
+    }
+}
+
+static unsigned long replay_get32(const unsigned char *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+int replay_open(replay_t *log, const char *path, unsigned long seed, board_t board) {
+    unsigned char header[REPLAY_HEADER_SIZE];
+    int i;
+
+    memset(header, 0x00, sizeof(header));
+    memcpy(header, replay_magic, sizeof(replay_magic));
+    header[4] = REPLAY_VERSION;
+    replay_put32(header + 8, seed);
+    for (i = 0; i < 8; ++i) {
+        header[12 + i] = (unsigned char)(board >> (i << 3));
+    }
+    log->moves = 0;
+    log->fp = fopen(path, "wb");
+    if (!log->fp) {
+        return 0;
+    }
+    if (fwrite(header, 1, sizeof(header), log->fp) != sizeof(header)) {
+        fclose(log->fp);
+        log->fp = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+int replay_move(replay_t *log, int move, board_t tile) {
+    int cell = 0;
+
+    if (!log->fp || tile == 0) {
+        return 0;
+    }
+    while ((tile & 0xf) == 0) {
+        tile >>= 4;
+        cell++;
+    }
+    log->moves++;
+    return putc((move & 3) | ((int)(tile - 1) << 2) | (cell << 3), log->fp) != EOF;
+}
+
+int replay_close(replay_t *log, unsigned long score) {
+    unsigned char trailer[REPLAY_TRAILER_SIZE];
+    int ret = 0;
+
+    if (!log->fp) {
+        return 0;
+    }
+    trailer[0] = REPLAY_END;
+    replay_put32(trailer + 1, log->moves);
+    replay_put32(trailer + 5, score);
+    ret = fwrite(trailer, 1, sizeof(trailer), log->fp) == sizeof(trailer);
+    if (fclose(log->fp) != 0) {
+        ret = 0;
+    }
+    log->fp = NULL;
+    return ret;
+}
+
+int replay_parse(const unsigned char *data, size_t size, replay_info_t *info) {
+    const unsigned char *end = NULL;
+    int i;
+
+    if (size < REPLAY_HEADER_SIZE || memcmp(data, replay_magic, sizeof(replay_magic)) != 0 || data[4] != REPLAY_VERSION) {
+        return 0;
+    }
+    info->seed = replay_get32(data + 8);
+    info->board = 0;
+    for (i = 7; i >= 0; --i) {
+        info->board = (info->board << 8) | data[12 + i];
+    }
+    info->moves = data + REPLAY_HEADER_SIZE;
+    end = data + size;
+    info->nmoves = 0;
+    while (info->moves + info->nmoves < end && !(info->moves[info->nmoves] & REPLAY_END)) {
+        info->nmoves++;
+    }
+    info->finished = 0;
+    info->final_moves = 0;
+    info->final_score = 0;
+    if (info->moves + info->nmoves < end) {
+        const unsigned char *trailer = info->moves + info->nmoves;
+
+        if ((size_t)(end - trailer) != REPLAY_TRAILER_SIZE || trailer[0] != REPLAY_END) {
+            return 0;
+        }
+        info->finished = 1;
+        info->final_moves = replay_get32(trailer + 1);
+        info->final_score = replay_get32(trailer + 5);
+    }
+    return 1;
+}
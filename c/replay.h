@@ -0,0 +1,59 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary game log, all integers little endian (include arch.h with
+ * SUPPORT_64BIT first):
+ *   header   "2KRP", version, 3 zero bytes, seed (4 bytes), initial board (8 bytes)
+ *   moves    one byte each: bits 0-1 move, bit 2 set for a 4-tile, bits 3-6 cell of the inserted tile
+ *   trailer  REPLAY_END, number of moves (4 bytes), final score (4 bytes)
+ * A log without trailer belongs to a game that did not finish.
+ */
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 20
+#define REPLAY_TRAILER_SIZE 9
+#define REPLAY_END 0x80
+
+#define REPLAY_MOVE(rec) ((rec) & 3)
+/* tile rank, 1 for a 2-tile and 2 for a 4-tile */
+#define REPLAY_TILE(rec) ((((rec) >> 2) & 1) + 1)
+#define REPLAY_CELL(rec) (((rec) >> 3) & 0xf)
+
+typedef struct {
+    FILE *fp;
+    unsigned long moves;
+} replay_t;
+
+typedef struct {
+    unsigned long seed;
+    board_t board;
+    const unsigned char *moves;
+    unsigned long nmoves;
+    int finished;               /* trailer present */
+    unsigned long final_moves;
+    unsigned long final_score;
+} replay_info_t;
+
+/* all writers return 0 on I/O errors */
+extern int replay_open(replay_t *log, const char *path, unsigned long seed, board_t board);
+
+/* tile is the inserted tile in place, i.e. the board after insertion xor the board before */
+extern int replay_move(replay_t *log, int move, board_t tile);
+
+extern int replay_close(replay_t *log, unsigned long score);
+
+/* split a log read into memory, returns 0 when it is not a valid log */
+extern int replay_parse(const unsigned char *data, size_t size, replay_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,9 +41,28 @@ typedef pthread_t THRD_HANDLE;
 #define USE_SYSINFO 1
 #endif
 
+#if defined(_WIN32) && defined(YieldProcessor)
+#define THRD_CPU_PAUSE() YieldProcessor()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define THRD_CPU_PAUSE() __asm__ __volatile__("rep; nop" ::: "memory")
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define THRD_CPU_PAUSE() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define THRD_CPU_PAUSE() ((void)0)
+#endif
+
+#ifndef THRD_SPIN_COUNT
+#define THRD_SPIN_COUNT 2000
+#endif
+#define THRD_SPIN_MIN 64
+
 typedef struct {
     thrd_callback func;
     void *param;
+    void *group;
+#if THRD_POOL_PROFILE
+    double enqueue_us;
+#endif
 } ThrdContext;
 
 typedef deque_t(ThrdContext) ThreadQueue;
@@ -101,6 +120,7 @@ typedef LEGACYCV_CTX ConditionVariable;
 typedef struct {
     CriticalSection mutex;
     ConditionVariable cond;
+    int spin_count;
 } THREADLOCK_CTX_;
 
 int threadlock_init(THREADLOCK_CTX *ctx) {
@@ -153,10 +173,25 @@ void threadlock_lock(THREADLOCK_CTX *ctx) {
 #ifdef _WIN32
     EnterCriticalSection(&ctx_->mutex);
 #else
+    int i = 0;
+    for (i = 0; i < ctx_->spin_count; ++i) {
+        if (pthread_mutex_trylock(&ctx_->mutex) == 0) {
+            return;
+        }
+        THRD_CPU_PAUSE();
+    }
     pthread_mutex_lock(&ctx_->mutex);
 #endif
 }
 
+void threadlock_setspin(THREADLOCK_CTX *ctx, int spin_count) {
+    THREADLOCK_CTX_ *ctx_ = (THREADLOCK_CTX_*)ctx->ctx;
+    ctx_->spin_count = (spin_count > 0) ? spin_count : 0;
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0403
+    SetCriticalSectionSpinCount(&ctx_->mutex, (DWORD)ctx_->spin_count);
+#endif
+}
+
 void threadlock_unlock(THREADLOCK_CTX *ctx) {
     THREADLOCK_CTX_ *ctx_ = (THREADLOCK_CTX_*)ctx->ctx;
 #ifdef _WIN32
@@ -222,6 +257,107 @@ void threadlock_broadcast(THREADLOCK_CTX *ctx) {
 #endif
 }
 
+typedef struct {
+    THREADLOCK_CTX lock;
+    volatile int pending;
+    int spin_count;
+} THREADGROUP_CTX_;
+
+int threadgroup_init(THREADGROUP_CTX *ctx) {
+    THREADGROUP_CTX_ *ctx_ = NULL;
+    if (!ctx->ctx) {
+        ctx->ctx = malloc(sizeof(THREADGROUP_CTX_));
+        if (!ctx->ctx) {
+            return 0;
+        }
+        memset(ctx->ctx, 0x00, sizeof(THREADGROUP_CTX_));
+    } else {
+        return 0;
+    }
+    ctx_ = (THREADGROUP_CTX_*)ctx->ctx;
+    if (!threadlock_init(&ctx_->lock)) {
+        free(ctx->ctx);
+        ctx->ctx = NULL;
+        return 0;
+    }
+    ctx_->pending = 0;
+    return 1;
+}
+
+void threadgroup_uninit(THREADGROUP_CTX *ctx) {
+    THREADGROUP_CTX_ *ctx_ = (THREADGROUP_CTX_*)ctx->ctx;
+    threadgroup_wait(ctx);
+    threadlock_uninit(&ctx_->lock);
+    free(ctx->ctx);
+    ctx->ctx = NULL;
+}
+
+void threadgroup_wait(THREADGROUP_CTX *ctx) {
+    THREADGROUP_CTX_ *ctx_ = (THREADGROUP_CTX_*)ctx->ctx;
+    int i = 0;
+    for (i = 0; i < ctx_->spin_count && ctx_->pending > 0; ++i) {
+        THRD_CPU_PAUSE();
+    }
+    threadlock_lock(&ctx_->lock);
+    while (ctx_->pending > 0) {
+        threadlock_wait(&ctx_->lock, -1);
+    }
+    threadlock_unlock(&ctx_->lock);
+}
+
+int threadgroup_pending(THREADGROUP_CTX *ctx) {
+    THREADGROUP_CTX_ *ctx_ = (THREADGROUP_CTX_*)ctx->ctx;
+    int pending = 0;
+    threadlock_lock(&ctx_->lock);
+    pending = ctx_->pending;
+    threadlock_unlock(&ctx_->lock);
+    return pending;
+}
+
+static void threadgroup_add(THREADGROUP_CTX_ *ctx_, int count, int spin_count) {
+    threadlock_lock(&ctx_->lock);
+    ctx_->pending += count;
+    if (spin_count >= 0) {
+        ctx_->spin_count = spin_count;
+    }
+    if (ctx_->pending <= 0) {
+        threadlock_broadcast(&ctx_->lock);
+    }
+    threadlock_unlock(&ctx_->lock);
+}
+
+#if THRD_POOL_PROFILE
+static double _clock_us(void) {
+#ifdef _WIN32
+    static double freq = 0.0;
+    LARGE_INTEGER counter;
+
+    if (freq == 0.0) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        freq = (double)f.QuadPart / 1000000.0;
+    }
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / freq;
+#else
+    struct timeval now = { 0, 0 };
+
+    gettimeofday(&now, NULL);
+    return (double)now.tv_sec * 1000000.0 + (double)now.tv_usec;
+#endif
+}
+
+static int _hist_bucket(double us) {
+    int bucket = 0;
+
+    while (us >= 1.0 && bucket < THRD_HIST_BUCKETS - 1) {
+        us /= 2.0;
+        bucket++;
+    }
+    return bucket;
+}
+#endif
+
 #if defined(WINVER) && WINVER >= 0x0501
 static DWORD _count_set_bits(ULONG_PTR bitMask) {
     DWORD LSHIFT = sizeof(ULONG_PTR) * 8 - 1;
@@ -296,7 +432,13 @@ typedef struct {
     int pool_signaled;
     int stop;
     int thrd_count;
-    int active_thrd_count;
+    volatile int active_thrd_count;
+    volatile int queued;
+    int spin_max;
+    int spin_limit;
+    int worker_seq;
+    THREADPOOL_STATS stats;
+    THREADWORKER_STATS *worker_stats;
     THRD_HANDLE *thread_handle;
 } THREADPOOL_CTX_;
 
@@ -305,35 +447,180 @@ int threadpool_thrdcount(THREADPOOL_CTX *ctx) {
     return ctx_->thrd_count;
 }
 
+static void threadpool_setspin_(THREADPOOL_CTX_ *ctx_, int spin_count) {
+    ctx_->spin_max = (spin_count > 0) ? spin_count : 0;
+    ctx_->spin_limit = ctx_->spin_max;
+    threadlock_setspin(&ctx_->pool_lock, ctx_->spin_max > 0 ? THRD_SPIN_MIN : 0);
+}
+
+void threadpool_setspin(THREADPOOL_CTX *ctx, int spin_count) {
+    THREADPOOL_CTX_ *ctx_ = (THREADPOOL_CTX_*)ctx->ctx;
+    threadlock_lock(&ctx_->pool_lock);
+    threadpool_setspin_(ctx_, spin_count);
+    threadlock_unlock(&ctx_->pool_lock);
+}
+
+void threadpool_getstats(THREADPOOL_CTX *ctx, THREADPOOL_STATS *stats) {
+    THREADPOOL_CTX_ *ctx_ = (THREADPOOL_CTX_*)ctx->ctx;
+    threadlock_lock(&ctx_->pool_lock);
+    memcpy(stats, &ctx_->stats, sizeof(THREADPOOL_STATS));
+    stats->spin_limit = ctx_->spin_limit;
+    threadlock_unlock(&ctx_->pool_lock);
+}
+
+int threadpool_getworkerstats(THREADPOOL_CTX *ctx, int index, THREADWORKER_STATS *stats) {
+    THREADPOOL_CTX_ *ctx_ = (THREADPOOL_CTX_*)ctx->ctx;
+    int ret = 0;
+    threadlock_lock(&ctx_->pool_lock);
+    if (ctx_->worker_stats && index >= 0 && index < ctx_->thrd_count) {
+        memcpy(stats, &ctx_->worker_stats[index], sizeof(THREADWORKER_STATS));
+        ret = 1;
+    }
+    threadlock_unlock(&ctx_->pool_lock);
+    return ret;
+}
+
+void threadpool_dumpstats(THREADPOOL_CTX *ctx, FILE *fp) {
+    THREADPOOL_STATS stats;
+#if THRD_POOL_PROFILE
+    THREADWORKER_STATS worker;
+    int i = 0;
+#endif
+
+    threadpool_getstats(ctx, &stats);
+    fprintf(fp, "Thread pool: %ld spin hits, %ld spin misses, %ld parks (spin limit=%d)\n",
+         stats.spin_hits, stats.spin_misses, stats.parks, stats.spin_limit);
+#if THRD_POOL_PROFILE
+    if (stats.tasks <= 0) {
+        return;
+    }
+    fprintf(fp, "Thread pool: %ld tasks, queue depth avg %.2f max %ld, wait avg %.1fus, run avg %.1fus\n",
+         stats.tasks, stats.queue_depth_sum / stats.tasks, stats.max_queue_depth,
+         stats.wait_us / stats.tasks, stats.run_us / stats.tasks);
+    for (i = 0; threadpool_getworkerstats(ctx, i, &worker); ++i) {
+        fprintf(fp, "  worker %d: %ld tasks, %ld parks, run %.1fms, idle %.1fms (busy %.1f%%)\n",
+             i, worker.tasks, worker.parks, worker.run_us / 1000.0, worker.idle_us / 1000.0,
+             (worker.run_us + worker.idle_us > 0.0) ? worker.run_us * 100.0 / (worker.run_us + worker.idle_us) : 0.0);
+    }
+    for (i = 0; i < THRD_HIST_BUCKETS; ++i) {
+        if (stats.wait_hist[i] || stats.run_hist[i]) {
+            fprintf(fp, "  < %8ldus: wait %ld, run %ld\n", 1L << i, stats.wait_hist[i], stats.run_hist[i]);
+        }
+    }
+#endif
+}
+
+static void threadpool_countpark(THREADPOOL_CTX_ *ctx_, int worker) {
+    ctx_->stats.parks++;
+    if (ctx_->worker_stats && worker < ctx_->thrd_count) {
+        ctx_->worker_stats[worker].parks++;
+    }
+}
+
+#if THRD_POOL_PROFILE
+static void threadpool_countstart(THREADPOOL_CTX_ *ctx_, int worker, const ThrdContext *context, double idle_us, double now_us) {
+    double wait_us = now_us - context->enqueue_us;
+
+    ctx_->stats.tasks++;
+    ctx_->stats.wait_us += wait_us;
+    ctx_->stats.wait_hist[_hist_bucket(wait_us)]++;
+    if (ctx_->worker_stats && worker < ctx_->thrd_count) {
+        ctx_->worker_stats[worker].tasks++;
+        ctx_->worker_stats[worker].idle_us += idle_us;
+    }
+}
+
+static void threadpool_countrun(THREADPOOL_CTX_ *ctx_, int worker, double run_us) {
+    ctx_->stats.run_us += run_us;
+    ctx_->stats.run_hist[_hist_bucket(run_us)]++;
+    if (ctx_->worker_stats && worker < ctx_->thrd_count) {
+        ctx_->worker_stats[worker].run_us += run_us;
+    }
+}
+#endif
+
+static int threadpool_spinwait(THREADPOOL_CTX_ *ctx_, int limit) {
+    int i = 0;
+    for (i = 0; i < limit; ++i) {
+        if (ctx_->queued > 0) {
+            return 1;
+        }
+        THRD_CPU_PAUSE();
+    }
+    return 0;
+}
+
+static void threadpool_adaptspin(THREADPOOL_CTX_ *ctx_, int found) {
+    if (found) {
+        ctx_->stats.spin_hits++;
+        ctx_->spin_limit = ((ctx_->spin_limit << 1) < ctx_->spin_max) ? (ctx_->spin_limit << 1) : ctx_->spin_max;
+    } else {
+        ctx_->stats.spin_misses++;
+        ctx_->spin_limit >>= 1;
+        if (ctx_->spin_limit < THRD_SPIN_MIN) {
+            ctx_->spin_limit = (THRD_SPIN_MIN < ctx_->spin_max) ? THRD_SPIN_MIN : ctx_->spin_max;
+        }
+    }
+}
+
 static void thread_instance(void *param) {
     THREADPOOL_CTX_ *ctx_ = (THREADPOOL_CTX_ *)param;
+    int spin = 1, worker = 0;
+#if THRD_POOL_PROFILE
+    double idle_start = _clock_us(), start = 0.0;
+#endif
 
+    threadlock_lock(&ctx_->pool_lock);
+    worker = ctx_->worker_seq++;
     while (1) {
         ThrdContext context;
-        threadlock_lock(&ctx_->pool_lock);
         if (deque_empty(&ctx_->queue)) {
             if (ctx_->stop) {
-                threadlock_unlock(&ctx_->pool_lock);
                 break;
             }
             ctx_->pool_signaled = 0;
             if (ctx_->active_thrd_count == 0) {
                 threadlock_broadcast(&ctx_->pool_lock);
             }
+            if (spin && ctx_->spin_limit > 0) {
+                int limit = ctx_->spin_limit, found = 0;
+                threadlock_unlock(&ctx_->pool_lock);
+                found = threadpool_spinwait(ctx_, limit);
+                threadlock_lock(&ctx_->pool_lock);
+                threadpool_adaptspin(ctx_, found);
+                spin = 0;
+                continue;
+            }
             while (!ctx_->pool_signaled) {
                 threadlock_wait(&ctx_->pool_lock, -1);
             }
-            threadlock_unlock(&ctx_->pool_lock);
+            threadpool_countpark(ctx_, worker);
+            spin = 1;
             continue;
         }
         memcpy(&context, deque_pop_front(&ctx_->queue), sizeof(ThrdContext));
+        ctx_->queued--;
         ctx_->active_thrd_count++;
+#if THRD_POOL_PROFILE
+        start = _clock_us();
+        threadpool_countstart(ctx_, worker, &context, start - idle_start, start);
+#endif
         threadlock_unlock(&ctx_->pool_lock);
         context.func(context.param);
+#if THRD_POOL_PROFILE
+        idle_start = _clock_us();
+#endif
+        if (context.group) {
+            threadgroup_add((THREADGROUP_CTX_ *)context.group, -1, -1);
+        }
         threadlock_lock(&ctx_->pool_lock);
         ctx_->active_thrd_count--;
-        threadlock_unlock(&ctx_->pool_lock);
+#if THRD_POOL_PROFILE
+        threadpool_countrun(ctx_, worker, idle_start - start);
+#endif
+        spin = 1;
     }
+    threadlock_unlock(&ctx_->pool_lock);
 }
 
 int threadpool_startup(THREADPOOL_CTX *ctx, int max_thrd_num) {
@@ -357,6 +644,7 @@ int threadpool_startup(THREADPOOL_CTX *ctx, int max_thrd_num) {
         }
         ctx_->thrd_context.func = thread_instance;
         ctx_->thrd_context.param = ctx_;
+        ctx_->thrd_context.group = NULL;
         if (!threadlock_init(&ctx_->pool_lock)) {
             break;
         }
@@ -367,7 +655,9 @@ int threadpool_startup(THREADPOOL_CTX *ctx, int max_thrd_num) {
         ctx_->stop = 1;
         ctx_->thrd_count = max_thrd_num;
         ctx_->active_thrd_count = 0;
+        ctx_->queued = 0;
         ctx_->thread_handle = NULL;
+        threadpool_setspin_(ctx_, threadpool_cpucount() > 1 ? THRD_SPIN_COUNT : 0);
         ret = 1;
     } while (0);
 
@@ -393,12 +683,16 @@ int threadpool_startup(THREADPOOL_CTX *ctx, int max_thrd_num) {
         if (!ctx_->thread_handle) {
             break;
         }
+        if (!ctx_->worker_stats) {
+            ctx_->worker_stats = (THREADWORKER_STATS *)calloc(ctx_->thrd_count, sizeof(THREADWORKER_STATS));
+        }
         threadlock_lock(&ctx_->pool_lock);
         if (!ctx_->stop) {
             threadlock_unlock(&ctx_->pool_lock);
             break;
         }
         ctx_->stop = 0;
+        ctx_->worker_seq = 0;
         threadlock_unlock(&ctx_->pool_lock);
         for (i = 0; i < ctx_->thrd_count; ++i) {
 #ifdef _WIN32
@@ -432,28 +726,76 @@ void threadpool_cleanup(THREADPOOL_CTX *ctx) {
     deque_delete(&ctx_->queue);
     threadlock_uninit(&ctx_->pool_lock);
     threadlock_uninit(&ctx_->ctrl_lock);
+    free(ctx_->worker_stats);
     free(ctx_->thread_handle);
     free(ctx->ctx);
     ctx->ctx = NULL;
 }
 
 int threadpool_addtask(THREADPOOL_CTX *ctx, thrd_callback func, void *param) {
+    THREADTASK task;
+
+    task.func = func;
+    task.param = param;
+    return threadpool_addtasks(ctx, &task, 1, NULL);
+}
+
+int threadpool_addtasks(THREADPOOL_CTX *ctx, const THREADTASK *tasks, int count, THREADGROUP_CTX *group) {
     THREADPOOL_CTX_ *ctx_ = (THREADPOOL_CTX_*)ctx->ctx;
+    THREADGROUP_CTX_ *group_ = group ? (THREADGROUP_CTX_*)group->ctx : NULL;
     ThrdContext context;
-    int ret = 0;
+    int i = 0;
 
+#if THRD_POOL_PROFILE
+    double now_us = 0.0;
+#endif
+
+    if (count <= 0) {
+        return 1;
+    }
+#if THRD_POOL_PROFILE
+    now_us = _clock_us();
+#endif
+    if (group_) {
+        threadgroup_add(group_, count, ctx_->spin_max);
+    }
     threadlock_lock(&ctx_->ctrl_lock);
-    context.func = func;
-    context.param = param;
     threadlock_lock(&ctx_->pool_lock);
-    if (deque_push_back(&ctx_->queue, context)) {
-        ret = 1;
+    for (i = 0; i < count; ++i) {
+        context.func = tasks[i].func;
+        context.param = tasks[i].param;
+        context.group = group_;
+#if THRD_POOL_PROFILE
+        context.enqueue_us = now_us;
+#endif
+        if (!deque_push_back(&ctx_->queue, context)) {
+            break;
+        }
+    }
+    ctx_->queued += i;
+#if THRD_POOL_PROFILE
+    ctx_->stats.queue_depth_sum += (double)ctx_->queued * i;
+    if (ctx_->queued > ctx_->stats.max_queue_depth) {
+        ctx_->stats.max_queue_depth = ctx_->queued;
+    }
+#endif
+    if (count == 1) {
+        threadlock_signal(&ctx_->pool_lock);
+    } else {
+        threadlock_broadcast(&ctx_->pool_lock);
     }
-    threadlock_signal(&ctx_->pool_lock);
     ctx_->pool_signaled = 1;
     threadlock_unlock(&ctx_->pool_lock);
     threadlock_unlock(&ctx_->ctrl_lock);
-    return ret;
+
+    /* the ring could not grow, run what is left on the caller's thread */
+    for (; i < count; ++i) {
+        tasks[i].func(tasks[i].param);
+        if (group_) {
+            threadgroup_add(group_, -1, -1);
+        }
+    }
+    return 1;
 }
 
 void threadpool_waitalltask(THREADPOOL_CTX *ctx) {
@@ -465,6 +807,14 @@ void threadpool_waitalltask(THREADPOOL_CTX *ctx) {
         threadlock_unlock(&ctx_->ctrl_lock);
         return;
     }
+    if (ctx_->spin_max > 0 && (!deque_empty(&ctx_->queue) || ctx_->active_thrd_count > 0)) {
+        int i = 0;
+        threadlock_unlock(&ctx_->pool_lock);
+        for (i = 0; i < ctx_->spin_max && (ctx_->queued > 0 || ctx_->active_thrd_count > 0); ++i) {
+            THRD_CPU_PAUSE();
+        }
+        threadlock_lock(&ctx_->pool_lock);
+    }
     while (!deque_empty(&ctx_->queue) || ctx_->active_thrd_count > 0) {
         threadlock_wait(&ctx_->pool_lock, -1);
     }
@@ -1,16 +1,49 @@
 #ifndef _THREAD_POOL_C_H_
 #define _THREAD_POOL_C_H_
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef THRD_POOL_PROFILE
+#define THRD_POOL_PROFILE 0
+#endif
+#define THRD_HIST_BUCKETS 24
+
 typedef struct {
     void *ctx;
-} THREADLOCK_CTX, THREADPOOL_CTX;
+} THREADLOCK_CTX, THREADPOOL_CTX, THREADGROUP_CTX;
 
 typedef void (*thrd_callback)(void *param);
 
+typedef struct {
+    thrd_callback func;
+    void *param;
+} THREADTASK;
+
+typedef struct {
+    long tasks;
+    long parks;
+    double run_us;
+    double idle_us;
+} THREADWORKER_STATS;
+
+typedef struct {
+    long spin_hits;
+    long spin_misses;
+    long parks;
+    int spin_limit;
+    long tasks;
+    long max_queue_depth;
+    double queue_depth_sum;
+    double wait_us;
+    double run_us;
+    long wait_hist[THRD_HIST_BUCKETS];
+    long run_hist[THRD_HIST_BUCKETS];
+} THREADPOOL_STATS;
+
 extern int threadlock_init(THREADLOCK_CTX *ctx);
 
 extern void threadlock_uninit(THREADLOCK_CTX *ctx);
@@ -19,24 +52,45 @@ extern void threadlock_lock(THREADLOCK_CTX *ctx);
 
 extern void threadlock_unlock(THREADLOCK_CTX *ctx);
 
+extern void threadlock_setspin(THREADLOCK_CTX *ctx, int spin_count);
+
 extern int threadlock_wait(THREADLOCK_CTX *ctx, int timeout_ms);
 
 extern void threadlock_signal(THREADLOCK_CTX *ctx);
 
 extern void threadlock_broadcast(THREADLOCK_CTX *ctx);
 
+extern int threadgroup_init(THREADGROUP_CTX *ctx);
+
+extern void threadgroup_uninit(THREADGROUP_CTX *ctx);
+
+extern void threadgroup_wait(THREADGROUP_CTX *ctx);
+
+extern int threadgroup_pending(THREADGROUP_CTX *ctx);
+
 extern int threadpool_startup(THREADPOOL_CTX *ctx, int max_thrd_num);
 
 extern void threadpool_cleanup(THREADPOOL_CTX *ctx);
 
 extern int threadpool_addtask(THREADPOOL_CTX *ctx, thrd_callback func, void *param);
 
+/* tasks the queue cannot take are run on the calling thread, so every task runs and group is always released */
+extern int threadpool_addtasks(THREADPOOL_CTX *ctx, const THREADTASK *tasks, int count, THREADGROUP_CTX *group);
+
 extern void threadpool_waitalltask(THREADPOOL_CTX *ctx);
 
 extern void threadpool_waitallthrd(THREADPOOL_CTX *ctx);
 
 extern int threadpool_thrdcount(THREADPOOL_CTX *ctx);
 
+extern void threadpool_setspin(THREADPOOL_CTX *ctx, int spin_count);
+
+extern void threadpool_getstats(THREADPOOL_CTX *ctx, THREADPOOL_STATS *stats);
+
+extern int threadpool_getworkerstats(THREADPOOL_CTX *ctx, int index, THREADWORKER_STATS *stats);
+
+extern void threadpool_dumpstats(THREADPOOL_CTX *ctx, FILE *fp);
+
 extern int threadpool_cpucount(void);
 
 #ifdef __cplusplus
@@ -1,7 +1,9 @@
 #define SUPPORT_64BIT 1
 #define AI_SOURCE 1
+#define AI_BITOPS 1
 #include "arch.h"
 #include <math.h>
+#include <stddef.h>
 
 #if MULTI_THREAD && OPENMP_THREAD
 #error "MULTI_THREAD and OPENMP_THREAD cannot be defined at the same time."
@@ -22,6 +24,114 @@
 #error "ENABLE_CACHE must be 0 (no cache) or 1 (use c++ map) or 2 (use c map)"
 #endif
 
+#if LAZY_SMP && !MULTI_THREAD
+#error "LAZY_SMP needs MULTI_THREAD."
+#endif
+
+/* expectimax as OpenMP tasks, the chance nodes below max nodes shallower than OPENMP_TASK_DEPTH run as tasks */
+#ifndef OPENMP_TASK
+#define OPENMP_TASK 0
+#endif
+#if OPENMP_TASK && !OPENMP_THREAD
+#error "OPENMP_TASK needs OPENMP_THREAD."
+#endif
+#ifndef OPENMP_TASK_DEPTH
+#define OPENMP_TASK_DEPTH 1
+#endif
+
+#if LAZY_SMP || OPENMP_TASK
+/* all threads share one lock-free table instead of a per-move cache */
+#undef ENABLE_CACHE
+#define ENABLE_CACHE 0
+#define SMP_TABLE 1
+#ifndef LAZY_SMP_TABLE_BITS
+#define LAZY_SMP_TABLE_BITS 20
+#endif
+#define LAZY_SMP_MAX_HELPERS 64
+
+typedef struct {
+    volatile board_t check;
+    volatile board_t data;
+} smp_table_entry_t;
+
+typedef union {
+    score_heur_t heuristic;
+    unsigned int bits;
+} smp_heur_bits_t;
+#endif
+
+#ifndef CHANCE_SYMMETRY
+#define CHANCE_SYMMETRY 0
+#endif
+
+/* bit 0: skip 4-tile children of unlikely cells, bit 1: sample cells of open positions */
+#ifndef CHANCE_PRUNE
+#define CHANCE_PRUNE 0
+#endif
+#ifndef CHANCE_PRUNE_CHECK
+#define CHANCE_PRUNE_CHECK 0
+#endif
+#if CHANCE_PRUNE_CHECK && (!CHANCE_PRUNE || LAZY_SMP || OPENMP_TASK)
+#error "CHANCE_PRUNE_CHECK needs CHANCE_PRUNE and does not support LAZY_SMP or OPENMP_TASK."
+#endif
+
+/* target nodes per decision, 0 keeps the tile based depth table */
+#ifndef NODE_BUDGET
+#define NODE_BUDGET 0
+#endif
+
+/* log every game to 2048-<seed>.rpl, see c/replay.h */
+#ifndef REPLAY_LOG
+#define REPLAY_LOG 0
+#endif
+#if REPLAY_LOG
+#include "replay.c"
+#endif
+
+/* evaluate leaves with an n-tuple network loaded from NTUPLE_FILE, see c/ntuple.h */
+#ifndef NTUPLE
+#define NTUPLE 0
+#endif
+#if NTUPLE
+#if defined(__16BIT__)
+#error "NTUPLE does not support 16-bit targets."
+#endif
+#ifndef NTUPLE_FILE
+#define NTUPLE_FILE "2048.ntw"
+#endif
+/* the network sees further than the row heuristic, so a shallow search is enough */
+#ifndef NTUPLE_DEPTH
+#define NTUPLE_DEPTH 2
+#endif
+#include "ntuple.c"
+#endif
+
+/* searches can be abandoned from another thread through a StopToken */
+#ifndef SEARCH_STOP
+#define SEARCH_STOP 0
+#endif
+#if SEARCH_STOP
+/*
+ * Cooperative stop: any thread may call stop(), the searches holding the
+ * token return 0 from the next move or chance node and count what they
+ * abandoned. A token is meant for one search, it cannot be rearmed.
+ */
+class StopToken {
+public:
+    StopToken() : m_stopped(0) {}
+
+    void stop() {
+        m_stopped = 1;
+    }
+    bool stopped() const {
+        return m_stopped != 0;
+    }
+
+private:
+    volatile int m_stopped;
+};
+#endif
+
 #if ENABLE_CACHE
 typedef struct {
     int depth;
@@ -37,8 +147,55 @@ typedef struct {
 #endif
 
 #if __cplusplus >= 201103L
+#include <new>
 #include <unordered_map>
-typedef std::unordered_map<board_t, trans_table_entry_t> trans_table_t;
+#include "arena.c"
+#define CACHE_ARENA 1
+
+/* nodes and buckets come from the per-move arena, freed all at once by arena_reset */
+template <class T>
+class arena_allocator {
+public:
+    typedef T value_type;
+
+    arena_allocator() : m_arena(NULL) {}
+    explicit arena_allocator(arena_t *arena) : m_arena(arena) {}
+    template <class U>
+    arena_allocator(const arena_allocator<U> &other) : m_arena(other.get_arena()) {}
+
+    T *allocate(size_t n) {
+        void *p = NULL;
+
+        if (!m_arena)
+            return (T *)::operator new(n * sizeof(T));
+        p = arena_alloc(m_arena, n * sizeof(T));
+        if (!p)
+            throw std::bad_alloc();
+        return (T *)p;
+    }
+    void deallocate(T *p, size_t /*n*/) {
+        if (!m_arena)
+            ::operator delete(p);
+    }
+    arena_t *get_arena() const {
+        return m_arena;
+    }
+
+    template <class U>
+    bool operator==(const arena_allocator<U> &other) const {
+        return m_arena == other.get_arena();
+    }
+    template <class U>
+    bool operator!=(const arena_allocator<U> &other) const {
+        return m_arena != other.get_arena();
+    }
+
+private:
+    arena_t *m_arena;
+};
+
+typedef std::unordered_map<board_t, trans_table_entry_t, std::hash<board_t>, std::equal_to<board_t>,
+    arena_allocator<std::pair<const board_t, trans_table_entry_t> > > trans_table_t;
 #define MAP_HAVE_SECOND 1
 #elif defined(_MSC_VER) && _MSC_VER >= 1500
 #include <unordered_map>
@@ -65,10 +222,13 @@ typedef std::map<board_t, trans_table_entry_t> trans_table_t;
 #endif
 
 #elif ENABLE_CACHE == 2
-#include "cmap.c"
-typedef map_t(board_t, trans_table_entry_t) trans_table_t;
+#include "imap.c"
+typedef imap_t(trans_table_entry_t) trans_table_t;
 #endif
 #endif
+#ifndef CACHE_ARENA
+#define CACHE_ARENA 0
+#endif
 
 enum {
     UP = 0,
@@ -77,30 +237,163 @@ enum {
     RIGHT,
 };
 
-const score_heur_t SCORE_LOST_PENALTY = 200000.0f;
-const score_heur_t SCORE_MONOTONICITY_POWER = 4.0f;
-const score_heur_t SCORE_MONOTONICITY_WEIGHT = 47.0f;
-const score_heur_t SCORE_SUM_POWER = 3.5f;
-const score_heur_t SCORE_SUM_WEIGHT = 11.0f;
-const score_heur_t SCORE_MERGES_WEIGHT = 700.0f;
-const score_heur_t SCORE_EMPTY_WEIGHT = 270.0f;
+/* heuristic weights, baked into score_heur_table by Game2048::build_heur_table() */
+typedef struct {
+    score_heur_t lost_penalty;
+    score_heur_t monotonicity_power;
+    score_heur_t monotonicity_weight;
+    score_heur_t sum_power;
+    score_heur_t sum_weight;
+    score_heur_t merges_weight;
+    score_heur_t empty_weight;
+} heur_weights_t;
+
+const heur_weights_t DEFAULT_HEUR_WEIGHTS = { 200000.0f, 4.0f, 47.0f, 3.5f, 11.0f, 700.0f, 270.0f };
+
+static const struct {
+    const char *name;
+    size_t offset;
+} heur_weight_names[] = {
+    { "lost_penalty", offsetof(heur_weights_t, lost_penalty) },
+    { "monotonicity_power", offsetof(heur_weights_t, monotonicity_power) },
+    { "monotonicity_weight", offsetof(heur_weights_t, monotonicity_weight) },
+    { "sum_power", offsetof(heur_weights_t, sum_power) },
+    { "sum_weight", offsetof(heur_weights_t, sum_weight) },
+    { "merges_weight", offsetof(heur_weights_t, merges_weight) },
+    { "empty_weight", offsetof(heur_weights_t, empty_weight) },
+};
+
+/* sets one weight from "name=value", returns false for unknown names or bad numbers */
+bool parse_heur_weight(heur_weights_t &weights, const char *arg) {
+    const char *value = strchr(arg, '=');
+    char *end = NULL;
+    double number = 0.0;
+
+    if (!value) {
+        return false;
+    }
+    number = strtod(value + 1, &end);
+    if (end == value + 1 || *end != '\0') {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(heur_weight_names) / sizeof(heur_weight_names[0]); ++i) {
+        if (strlen(heur_weight_names[i].name) == (size_t)(value - arg) && strncmp(arg, heur_weight_names[i].name, value - arg) == 0) {
+            *(score_heur_t *)((char *)&weights + heur_weight_names[i].offset) = (score_heur_t)number;
+            return true;
+        }
+    }
+    return false;
+}
+
+void print_heur_weights(FILE *fp, const heur_weights_t &weights) {
+    for (size_t i = 0; i < sizeof(heur_weight_names) / sizeof(heur_weight_names[0]); ++i) {
+        fprintf(fp, "%s%s=%g", i ? " " : "", heur_weight_names[i].name, *(const score_heur_t *)((const char *)&weights + heur_weight_names[i].offset));
+    }
+    fprintf(fp, "\n");
+}
+
 const score_heur_t CPROB_THRESH_BASE = 0.0001f;
+#if CHANCE_PRUNE & 1
+#ifndef CHANCE_PRUNE_CPROB
+#define CHANCE_PRUNE_CPROB 0.002f
+#endif
+#endif
+#if CHANCE_PRUNE & 2
+#ifndef CHANCE_SAMPLE_OPEN
+#define CHANCE_SAMPLE_OPEN 10
+#endif
+#ifndef CHANCE_SAMPLE_CELLS
+#define CHANCE_SAMPLE_CELLS 6
+#endif
+#endif
 #if ENABLE_CACHE
 const row_t CACHE_DEPTH_LIMIT = 15;
 #endif
+#if CACHE_ARENA
+const size_t CACHE_ARENA_CHUNK = 262144;
+#endif
+#if NODE_BUDGET
+const int BUDGET_DEPTH_MIN = 2;
+const int BUDGET_DEPTH_MAX = 8;
+const score_heur_t BUDGET_CPROB_MIN = 0.000001f;
+const score_heur_t BUDGET_CPROB_MAX = 0.05f;
+#endif
+
+/* distinct for every Game2048 of the process, it also names the replay log */
+static unsigned int next_seed() {
+    static unsigned int count = 0;
+
+    return (unsigned int)time(NULL) + count++;
+}
 
 class Game2048 {
+    /* cpp/2048-analyze.cpp, cpp/2048-tune.cpp, cpp/2048-td.cpp, cpp/2048-hint.cpp and cpp/2048-check.cpp use the internals directly */
+    friend class Analyze2048;
+    friend class Tune2048;
+    friend class Train2048;
+    friend class Hint2048;
+    friend class Check2048;
+
 public:
-    Game2048() {
+    Game2048() : m_seed(next_seed()), m_weights(DEFAULT_HEUR_WEIGHTS), m_heur_built(false) {
+        srand(m_seed);
         alloc_tables();
+#if SEARCH_STOP
+        m_stop = NULL;
+#endif
+#if NTUPLE
+        memset(&m_net, 0x00, sizeof(m_net));
+#endif
+#if NODE_BUDGET
+        m_budget_depth = 3;
+        m_budget_cprob = CPROB_THRESH_BASE;
+#endif
+#if CACHE_ARENA
+        for (int i = 0; i < 4; ++i) {
+            arena_init(&m_cache_arena[i], CACHE_ARENA_CHUNK);
+        }
+#elif ENABLE_CACHE == 2
+        for (int i = 0; i < 4; ++i) {
+            imap_init(&m_trans_table[i]);
+        }
+#endif
     }
     ~Game2048() {
+#if CACHE_ARENA
+        for (int i = 0; i < 4; ++i) {
+            arena_delete(&m_cache_arena[i]);
+        }
+#elif ENABLE_CACHE == 2
+        for (int i = 0; i < 4; ++i) {
+            imap_delete(&m_trans_table[i]);
+        }
+#endif
         free_tables();
+#if NTUPLE
+        ntuple_free(&m_net);
+#endif
     }
 
     void play_game();
 
+#if SEARCH_STOP
+    /* -1 when stop was set before any root move finished, otherwise the best of the finished ones */
+    int find_best_move(board_t board, StopToken *stop = NULL);
+#else
     int find_best_move(board_t board);
+#endif
+
+    /* rebuilds score_heur_table only, each object keeps its own weights and tables */
+    void set_weights(const heur_weights_t &weights);
+    const heur_weights_t &get_weights() const {
+        return m_weights;
+    }
+#if NTUPLE
+    bool load_ntuple(const char *path) {
+        ntuple_free(&m_net);
+        return ntuple_load(&m_net, path) != 0;
+    }
+#endif
 
 private:
     inline board_t unpack_col(row_t row) {
@@ -114,8 +407,16 @@ private:
     void print_board(board_t board);
     board_t transpose(board_t x);
     int count_empty(board_t x);
+    unsigned int empty_mask(board_t x);
+    board_t mirror_lr(board_t x);
+    board_t mirror_ud(board_t x);
+    bool same_position(board_t a, board_t b);
+#if CHANCE_SYMMETRY
+    int chance_symmetry(board_t board);
+#endif
 
     void init_tables();
+    void build_heur_table();
     void alloc_tables();
     void free_tables();
 
@@ -137,16 +438,74 @@ private:
         long cachehits;
         long moves_evaled;
         int depth_limit;
+        score_heur_t cprob_thresh;
 #if ENABLE_CACHE
-        trans_table_t trans_table;
+        trans_table_t *trans_table;
+#endif
+#if SEARCH_STOP
+        StopToken *stop;
+        long abandoned;         /* nodes that returned early, 0 when the result is complete */
+#endif
+#if LAZY_SMP
+        int move_offset;
+#endif
+#if CHANCE_PRUNE
+        int prune;
+        long pruned;
+        long sampled;
+        score_heur_t pruned_prob;
 #endif
 
-        eval_state() : maxdepth(0), curdepth(0), nomoves(0), tablehits(0), cachehits(0), moves_evaled(0), depth_limit(0) {}
+        eval_state() : maxdepth(0), curdepth(0), nomoves(0), tablehits(0), cachehits(0), moves_evaled(0), depth_limit(0), cprob_thresh(CPROB_THRESH_BASE) {
+#if LAZY_SMP
+            move_offset = 0;
+#endif
+#if SEARCH_STOP
+            stop = NULL;
+            abandoned = 0;
+#endif
+#if CHANCE_PRUNE
+            prune = 1;
+            pruned = 0;
+            sampled = 0;
+            pruned_prob = 0.0f;
+#endif
+        }
     };
     int get_depth_limit(board_t board);
+#if NODE_BUDGET
+    void update_node_budget(long nodes);
+
+    int m_budget_depth;
+    score_heur_t m_budget_cprob;
+    long m_root_nodes[4];
+#endif
+#if CACHE_ARENA
+    /* one arena per root move, each root move is searched by a single thread */
+    arena_t m_cache_arena[4];
+#elif ENABLE_CACHE == 2
+    /* one table per root move, kept across decisions */
+    trans_table_t m_trans_table[4];
+#endif
     score_heur_t score_move_node(eval_state &state, board_t board, score_heur_t cprob);
     score_heur_t score_tilechoose_node(eval_state &state, board_t board, score_heur_t cprob);
+#if OPENMP_TASK
+    score_heur_t score_move_tasks(eval_state &state, board_t board, score_heur_t cprob);
+    void fork_state(eval_state &child, const eval_state &state);
+    void join_state(eval_state &state, const eval_state &child);
+#endif
     score_heur_t score_toplevel_move(board_t board, int move);
+    int root_moves(board_t board, int *first);
+    void finish_root_moves(const int *first, score_heur_t *res);
+#if SEARCH_STOP
+    int drop_stopped_moves(const int *first, score_heur_t *res, const long *abandoned);
+#endif
+#if CHANCE_PRUNE & 2
+    unsigned int sample_cells(board_t board, unsigned int mask, int count);
+#endif
+#if CHANCE_PRUNE_CHECK
+    score_heur_t score_toplevel_exact(board_t newboard, int depth_limit, long &moves_evaled);
+#endif
 
 #if MULTI_THREAD
     typedef struct {
@@ -159,6 +518,42 @@ private:
     static void thrd_worker(void *param);
 #endif
 
+#if LAZY_SMP
+    typedef struct {
+        Game2048 *pthis;
+        board_t board;
+        int helper;
+        int depth_limit;
+        const int *first;
+        score_heur_t res[4];
+#if SEARCH_STOP
+        long abandoned[4];
+#endif
+    } smp_context;
+
+    static void smp_worker(void *param);
+    void score_smp_root(smp_context &context);
+#endif
+#if SMP_TABLE
+    bool smp_table_get(board_t board, int depth, score_heur_t &heuristic);
+    void smp_table_set(board_t board, int depth, score_heur_t heuristic);
+
+    smp_table_entry_t *smp_table;
+#endif
+
+    unsigned int m_seed;
+    heur_weights_t m_weights;
+    /* score_heur_table holds m_weights, init_tables() then leaves it alone */
+    bool m_heur_built;
+#if NTUPLE
+    ntuple_net_t m_net;
+#endif
+#if SEARCH_STOP
+    /* token of the running find_best_move(), NULL when it cannot be stopped */
+    StopToken *m_stop;
+    long m_abandoned[4];
+#endif
+
 #ifndef __16BIT__
 #define TABLESIZE 65536
     row_t *row_left_table;
@@ -167,19 +562,15 @@ private:
     score_heur_t *score_heur_table;
 #else
 #define TABLESIZE 8192
+/* the top 3 bits of a row pick the segment, the low 13 bits the entry */
+#define TABLE_SEGMENT(row) ((row) >> 13)
+#define TABLE_INDEX(row) ((row) & (TABLESIZE - 1))
     row_t *row_table[8];
     score_heur_t *score_heur_table[8];
 #endif
 };
 
 unsigned int Game2048::unif_random(unsigned int n) {
-    static unsigned int seeded = 0;
-
-    if (!seeded) {
-        srand((unsigned int)time(NULL));
-        seeded = 1;
-    }
-
     return rand() % n;
 }
 
@@ -226,6 +617,61 @@ int Game2048::count_empty(board_t x) {
     return (int)(x & 0xf);
 }
 
+/* bit i set if cell i (nibble i) is empty */
+unsigned int Game2048::empty_mask(board_t x) {
+    x |= (x >> 2) & W64LIT(0x3333333333333333);
+    x |= x >> 1;
+    x = ~x & W64LIT(0x1111111111111111);
+    x = (x | (x >> 3)) & W64LIT(0x0303030303030303);
+    x = (x | (x >> 6)) & W64LIT(0x000F000F000F000F);
+    x = (x | (x >> 12)) & W64LIT(0x000000FF000000FF);
+    x = (x | (x >> 24)) & W64LIT(0x000000000000FFFF);
+    return (unsigned int)x;
+}
+
+board_t Game2048::mirror_lr(board_t x) {
+    return ((x >> 12) & W64LIT(0x000F000F000F000F)) | ((x >> 4) & W64LIT(0x00F000F000F000F0)) |
+        ((x << 4) & W64LIT(0x0F000F000F000F00)) | ((x << 12) & W64LIT(0xF000F000F000F000));
+}
+
+board_t Game2048::mirror_ud(board_t x) {
+    return (x >> 48) | ((x >> 16) & W64LIT(0x00000000FFFF0000)) |
+        ((x << 16) & W64LIT(0x0000FFFF00000000)) | (x << 48);
+}
+
+/* b is a or one of its rotations and reflections, the heuristic scores them all alike */
+bool Game2048::same_position(board_t a, board_t b) {
+    board_t t = transpose(a);
+    board_t lr = mirror_lr(a), tlr = mirror_lr(t);
+
+    return b == a || b == lr || b == mirror_ud(a) || b == mirror_ud(lr) ||
+        b == t || b == tlr || b == mirror_ud(t) || b == mirror_ud(tlr);
+}
+
+#if CHANCE_SYMMETRY
+/*
+ * Mirrors that map the board onto itself, as a set of cell index xor masks:
+ * bit 0 left-right (i ^ 3), bit 1 up-down (i ^ 12), bit 2 rotation by 180 degrees (i ^ 15).
+ */
+int Game2048::chance_symmetry(board_t board) {
+    board_t lr = mirror_lr(board);
+    int sym = 0;
+
+    if (lr == board)
+        sym |= 1;
+    if (mirror_ud(board) == board)
+        sym |= 2;
+    if (mirror_ud(lr) == board)
+        sym |= 4;
+    return sym;
+}
+
+/* cells that are the smallest index of their orbit, per chance_symmetry() result */
+static const unsigned int chance_canon_mask[8] = {
+    0xFFFF, 0x3333, 0x00FF, 0x0033, 0x00FF, 0x0033, 0x00FF, 0x0033
+};
+#endif
+
 void Game2048::init_tables() {
     row_t row = 0, result = 0;
 #ifndef __16BIT__
@@ -253,16 +699,83 @@ void Game2048::init_tables() {
         score_table[row] = score;
 #endif
 
+        for (i = 0; i < 3; ++i) {
+            for (j = i + 1; j < 4; ++j) {
+                if (line[j] != 0)
+                    break;
+            }
+            if (j == 4)
+                break;
+
+            if (line[i] == 0) {
+                line[i] = line[j];
+                line[j] = 0;
+                i--;
+            } else if (line[i] == line[j]) {
+                if (line[i] != 0xf) {
+                    line[i]++;
+                }
+                line[j] = 0;
+            }
+        }
+
+        result = line[0] | (line[1] << 4) | (line[2] << 8) | (line[3] << 12);
+
+#ifndef __16BIT__
+        rev_row = reverse_row(row);
+        rev_result = reverse_row(result);
+        row_left_table[row] = row ^ result;
+        row_right_table[rev_row] = rev_row ^ rev_result;
+#else
+        row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] = row ^ result;
+#endif
+    } while (row++ != 0xFFFF);
+    if (!m_heur_built) {
+        build_heur_table();
+    }
+}
+
+void Game2048::set_weights(const heur_weights_t &weights) {
+    m_weights = weights;
+    build_heur_table();
+}
+
+void Game2048::build_heur_table() {
+    const heur_weights_t &w = m_weights;
+    score_heur_t sum_pow[16];
+    /* monotonicity term of each pair of neighbours, same expression as per row */
+    score_heur_t mono_diff[16][16];
+    long row = 0;
+    int i = 0, j = 0;
+
+    for (i = 0; i < 16; ++i) {
+        sum_pow[i] = (score_heur_t)pow((score_heur_t)i, w.sum_power);
+        for (j = 0; j < 16; ++j) {
+            mono_diff[i][j] = (score_heur_t)(pow((score_heur_t)i, w.monotonicity_power) - pow((score_heur_t)j, w.monotonicity_power));
+        }
+    }
+
+#if OPENMP_THREAD
+#pragma omp parallel for
+#endif
+    for (row = 0; row < 65536L; ++row) {
+        score_t line[4];
         score_heur_t sum = 0.0f;
         score_t empty = 0;
         score_t merges = 0;
         score_t prev = 0;
         score_t counter = 0;
+        int k = 0;
 
-        for (i = 0; i < 4; ++i) {
-            score_t rank = line[i];
+        line[0] = (score_t)(row & 0xf);
+        line[1] = (score_t)((row >> 4) & 0xf);
+        line[2] = (score_t)((row >> 8) & 0xf);
+        line[3] = (score_t)((row >> 12) & 0xf);
 
-            sum += (score_heur_t)pow((score_heur_t)rank, SCORE_SUM_POWER);
+        for (k = 0; k < 4; ++k) {
+            score_t rank = line[k];
+
+            sum += sum_pow[rank];
             if (rank == 0) {
                 empty++;
             } else {
@@ -282,55 +795,23 @@ void Game2048::init_tables() {
         score_heur_t monotonicity_left = 0.0f;
         score_heur_t monotonicity_right = 0.0f;
 
-        for (i = 1; i < 4; ++i) {
-            if (line[i - 1] > line[i]) {
-                monotonicity_left +=
-                    (score_heur_t)(pow((score_heur_t)line[i - 1], SCORE_MONOTONICITY_POWER) - pow((score_heur_t)line[i], SCORE_MONOTONICITY_POWER));
+        for (k = 1; k < 4; ++k) {
+            if (line[k - 1] > line[k]) {
+                monotonicity_left += mono_diff[line[k - 1]][line[k]];
             } else {
-                monotonicity_right +=
-                    (score_heur_t)(pow((score_heur_t)line[i], SCORE_MONOTONICITY_POWER) - pow((score_heur_t)line[i - 1], SCORE_MONOTONICITY_POWER));
-            }
-        }
-
-#ifndef __16BIT__
-        score_heur_table[row] = (score_heur_t)(SCORE_LOST_PENALTY + SCORE_EMPTY_WEIGHT * empty + SCORE_MERGES_WEIGHT * merges -
-            SCORE_MONOTONICITY_WEIGHT * _min(monotonicity_left, monotonicity_right) - SCORE_SUM_WEIGHT * sum);
-#else
-        score_heur_table[row / TABLESIZE][row % TABLESIZE] = (score_heur_t)(SCORE_LOST_PENALTY + SCORE_EMPTY_WEIGHT * empty + SCORE_MERGES_WEIGHT * merges -
-            SCORE_MONOTONICITY_WEIGHT * _min(monotonicity_left, monotonicity_right) - SCORE_SUM_WEIGHT * sum);
-#endif
-
-        for (i = 0; i < 3; ++i) {
-            for (j = i + 1; j < 4; ++j) {
-                if (line[j] != 0)
-                    break;
-            }
-            if (j == 4)
-                break;
-
-            if (line[i] == 0) {
-                line[i] = line[j];
-                line[j] = 0;
-                i--;
-            } else if (line[i] == line[j]) {
-                if (line[i] != 0xf) {
-                    line[i]++;
-                }
-                line[j] = 0;
+                monotonicity_right += mono_diff[line[k]][line[k - 1]];
             }
         }
 
-        result = line[0] | (line[1] << 4) | (line[2] << 8) | (line[3] << 12);
-
 #ifndef __16BIT__
-        rev_row = reverse_row(row);
-        rev_result = reverse_row(result);
-        row_left_table[row] = row ^ result;
-        row_right_table[rev_row] = rev_row ^ rev_result;
+        score_heur_table[row] = (score_heur_t)(w.lost_penalty + w.empty_weight * empty + w.merges_weight * merges -
+            w.monotonicity_weight * _min(monotonicity_left, monotonicity_right) - w.sum_weight * sum);
 #else
-        row_table[row / TABLESIZE][row % TABLESIZE] = row ^ result;
+        score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] = (score_heur_t)(w.lost_penalty + w.empty_weight * empty + w.merges_weight * merges -
+            w.monotonicity_weight * _min(monotonicity_left, monotonicity_right) - w.sum_weight * sum);
 #endif
-    } while (row++ != 0xFFFF);
+    }
+    m_heur_built = true;
 }
 
 #ifndef __16BIT__
@@ -344,6 +825,14 @@ void Game2048::alloc_tables() {
         fflush(stderr);
         abort();
     }
+#if SMP_TABLE
+    smp_table = (smp_table_entry_t *)calloc((size_t)1 << LAZY_SMP_TABLE_BITS, sizeof(smp_table_entry_t));
+    if (!smp_table) {
+        fprintf(stderr, "Not enough memory.");
+        fflush(stderr);
+        abort();
+    }
+#endif
 }
 
 void Game2048::free_tables() {
@@ -351,6 +840,9 @@ void Game2048::free_tables() {
     free(row_right_table);
     free(score_table);
     free(score_heur_table);
+#if SMP_TABLE
+    free(smp_table);
+#endif
 }
 
 board_t Game2048::execute_move(board_t board, int move) {
@@ -420,23 +912,23 @@ board_t Game2048::execute_move(board_t board, int move) {
         board = transpose(board);
         for (int i = 0; i < 4; ++i) {
             row_t row = (board >> (i << 4)) & ROW_MASK;
-            ret ^= unpack_col(row_table[row / TABLESIZE][row % TABLESIZE]) << (i << 2);
+            ret ^= unpack_col(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)]) << (i << 2);
         }
     } else if (move == DOWN) {
         board = transpose(board);
         for (int i = 0; i < 4; ++i) {
             row_t row = reverse_row((board >> (i << 4)) & ROW_MASK);
-            ret ^= unpack_col(reverse_row(row_table[row / TABLESIZE][row % TABLESIZE])) << (i << 2);
+            ret ^= unpack_col(reverse_row(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)])) << (i << 2);
         }
     } else if (move == LEFT) {
         for (int i = 0; i < 4; ++i) {
             row_t row = (board >> (i << 4)) & ROW_MASK;
-            ret ^= (board_t)(row_table[row / TABLESIZE][row % TABLESIZE]) << (i << 4);
+            ret ^= (board_t)(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)]) << (i << 4);
         }
     } else if (move == RIGHT) {
         for (int i = 0; i < 4; ++i) {
             row_t row = reverse_row((board >> (i << 4)) & ROW_MASK);
-            ret ^= (board_t)(reverse_row(row_table[row / TABLESIZE][row % TABLESIZE])) << (i << 4);
+            ret ^= (board_t)(reverse_row(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)])) << (i << 4);
         }
     }
     return ret;
@@ -461,7 +953,7 @@ score_heur_t Game2048::score_heur_helper(board_t board) {
     score_heur_t score_heur = 0.0f;
     for (int i = 0; i < 4; ++i) {
         row_t row = (board >> (i << 4)) & ROW_MASK;
-        score_heur += score_heur_table[row / TABLESIZE][row % TABLESIZE];
+        score_heur += score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
     }
     return score_heur;
 }
@@ -472,7 +964,14 @@ score_t Game2048::score_board(board_t board) {
 }
 
 score_heur_t Game2048::score_heur_board(board_t board) {
+#if NTUPLE
+    score_heur_t value = ntuple_value(&m_net, board);
+
+    /* 0 stays the value of a lost board */
+    return value > 0.0f ? value : 0.0f;
+#else
     return score_heur_helper(board) + score_heur_helper(transpose(board));
+#endif
 }
 
 row_t Game2048::draw_tile() {
@@ -503,7 +1002,48 @@ board_t Game2048::initial_board() {
     return insert_tile_rand(board, draw_tile());
 }
 
-#ifndef __16BIT__
+#if NODE_BUDGET
+int Game2048::get_depth_limit(board_t board) {
+    (void)board;
+    return m_budget_depth;
+}
+
+/*
+ * Fit an effective branching factor to the nodes the last decision took at
+ * its depth, then pick the shallowest depth predicted to reach NODE_BUDGET.
+ * The cprob threshold trims the overshoot: it rises by the square root of the
+ * predicted excess and falls the same way when the prediction comes up short.
+ */
+void Game2048::update_node_budget(long nodes) {
+    int depth = m_budget_depth;
+    double branch = 0.0, predicted = (double)nodes;
+
+    if (nodes <= 0)
+        return;
+    branch = pow((double)nodes, 1.0 / depth);
+    if (branch < 1.5)
+        branch = 1.5;
+    while (depth < BUDGET_DEPTH_MAX && predicted < (double)NODE_BUDGET) {
+        predicted *= branch;
+        depth++;
+    }
+    while (depth > BUDGET_DEPTH_MIN && predicted / branch >= (double)NODE_BUDGET) {
+        predicted /= branch;
+        depth--;
+    }
+    m_budget_cprob *= (score_heur_t)sqrt(predicted / (double)NODE_BUDGET);
+    m_budget_cprob = _max(_min(m_budget_cprob, BUDGET_CPROB_MAX), BUDGET_CPROB_MIN);
+
+    printf("Node budget: %ld nodes at depth %d (branching %.2f), next depth %d, cprob threshold %g\n",
+         nodes, m_budget_depth, branch, depth, (double)m_budget_cprob);
+    m_budget_depth = depth;
+}
+#elif NTUPLE
+int Game2048::get_depth_limit(board_t board) {
+    (void)board;
+    return NTUPLE_DEPTH;
+}
+#elif !defined(__16BIT__)
 int Game2048::get_depth_limit(board_t board) {
     row_t bitset = 0, max_limit = 3;
     int count = 0;
@@ -517,7 +1057,7 @@ int Game2048::get_depth_limit(board_t board) {
         return max_limit;
     } else if (bitset <= 2048 + 1024) {
         max_limit = 4;
-#if ENABLE_CACHE
+#if ENABLE_CACHE || SMP_TABLE
     } else if (bitset <= 4096) {
         max_limit = 5;
     } else if (bitset <= 4096 + 2048) {
@@ -545,23 +1085,65 @@ int Game2048::get_depth_limit(board_t board) {
 }
 #endif
 
+#if CHANCE_PRUNE & 2
+/*
+ * Keep CHANCE_SAMPLE_CELLS of the count cells in mask, one from each run of
+ * consecutive empty cells, so the sample stays spread over the board. The
+ * pick inside a run is a hash of the board, which keeps the search
+ * deterministic and thread safe.
+ */
+unsigned int Game2048::sample_cells(board_t board, unsigned int mask, int count) {
+    unsigned int hash = (unsigned int)((board * W64LIT(0x9E3779B97F4A7C15)) >> 32);
+    unsigned int sample = 0;
+    int index = 0, stratum = 0;
+    int pick = (int)(hash % (unsigned int)(count / CHANCE_SAMPLE_CELLS));
+
+    while (mask) {
+        if (index == pick) {
+            sample |= mask & (0u - mask);
+            stratum++;
+            if (stratum == CHANCE_SAMPLE_CELLS)
+                break;
+            hash = hash * 1103515245u + 12345u;
+            pick = stratum * count / CHANCE_SAMPLE_CELLS;
+            pick += (int)((hash >> 16) % (unsigned int)((stratum + 1) * count / CHANCE_SAMPLE_CELLS - pick));
+        }
+        mask &= mask - 1;
+        index++;
+    }
+    return sample;
+}
+#endif
+
 score_heur_t Game2048::score_tilechoose_node(eval_state &state, board_t board, score_heur_t cprob) {
-    if (cprob < CPROB_THRESH_BASE || state.curdepth >= state.depth_limit) {
+#if SEARCH_STOP
+    if (state.stop && state.stop->stopped()) {
+        state.abandoned++;
+        return 0.0f;
+    }
+#endif
+    if (cprob < state.cprob_thresh || state.curdepth >= state.depth_limit) {
         state.maxdepth = _max(state.curdepth, state.maxdepth);
         state.tablehits++;
         return score_heur_board(board);
     }
-#if ENABLE_CACHE == 1
+#if SMP_TABLE
+    score_heur_t cached = 0.0f;
+    if (smp_table_get(board, state.depth_limit - state.curdepth, cached)) {
+        state.cachehits++;
+        return cached;
+    }
+#elif ENABLE_CACHE == 1
     if (state.curdepth < CACHE_DEPTH_LIMIT) {
 #if !defined(__WATCOMC__)
         const
 #endif
-        trans_table_t::iterator &i = state.trans_table.find(board);
-        if (i != state.trans_table.end()) {
+        trans_table_t::iterator &i = state.trans_table->find(board);
+        if (i != state.trans_table->end()) {
 #ifdef MAP_HAVE_SECOND
             trans_table_entry_t &entry = i->second;
 #else
-            trans_table_entry_t &entry = state.trans_table[board];
+            trans_table_entry_t &entry = (*state.trans_table)[board];
 #endif
 
             if (entry.depth <= state.curdepth) {
@@ -572,7 +1154,7 @@ score_heur_t Game2048::score_tilechoose_node(eval_state &state, board_t board, s
     }
 #elif ENABLE_CACHE == 2
     if (state.curdepth < CACHE_DEPTH_LIMIT) {
-        trans_table_entry_t *entry = (trans_table_entry_t *)map_get(&state.trans_table, board);
+        trans_table_entry_t *entry = (trans_table_entry_t *)imap_get(state.trans_table, board);
         if (entry != NULL) {
             if (entry->depth <= state.curdepth) {
                 state.cachehits++;
@@ -582,35 +1164,86 @@ score_heur_t Game2048::score_tilechoose_node(eval_state &state, board_t board, s
     }
 #endif
 
-    int num_open = count_empty(board);
+    unsigned int mask = empty_mask(board);
+    int num_open = popcount(mask);
 
     cprob /= num_open;
 
     score_heur_t res = 0.0f;
-    board_t tmp = board;
-    board_t tile_2 = 1;
+#if CHANCE_SYMMETRY
+    int sym = chance_symmetry(board);
+    score_heur_t weight = (score_heur_t)(1 + popcount(sym));
 
-    while (tile_2) {
-        if ((tmp & 0xf) == 0) {
-            res += score_move_node(state, board | tile_2, cprob * 0.9f) * 0.9f;
-            res += score_move_node(state, board | (tile_2 << 1), cprob * 0.1f) * 0.1f;
+    mask &= chance_canon_mask[sym];
+#endif
+#if CHANCE_PRUNE & 2
+    int num_eval = num_open;
+
+    if (state.prune && num_open >= CHANCE_SAMPLE_OPEN) {
+        int count = popcount(mask);
+
+        if (count > CHANCE_SAMPLE_CELLS) {
+            mask = sample_cells(board, mask, count);
+            num_eval = num_open / count * CHANCE_SAMPLE_CELLS;
+            state.sampled++;
+            state.pruned_prob += cprob * (num_open - num_eval);
         }
-        tmp >>= 4;
-        tile_2 <<= 4;
     }
+#endif
+
+    while (mask) {
+        int shift = ctz(mask) << 2;
+        board_t tile_2 = (board_t)1 << shift;
+#if CHANCE_SYMMETRY
+        score_heur_t sub = 0.0f;
+#else
+        score_heur_t &sub = res;
+#endif
+#if CHANCE_PRUNE & 1
+        /* an unlikely cell is scored by its 2-tile child alone */
+        int two_only = state.prune && cprob < CHANCE_PRUNE_CPROB;
+        score_heur_t prob_2 = two_only ? 1.0f : 0.9f;
+
+        if (two_only) {
+            state.pruned++;
+#if CHANCE_SYMMETRY
+            state.pruned_prob += cprob * 0.1f * weight;
+#else
+            state.pruned_prob += cprob * 0.1f;
+#endif
+        }
+#else
+        const int two_only = 0;
+        const score_heur_t prob_2 = 0.9f;
+#endif
+
+        sub += score_move_node(state, board | tile_2, cprob * 0.9f) * prob_2;
+        if (!two_only)
+            sub += score_move_node(state, board | (tile_2 << 1), cprob * 0.1f) * 0.1f;
+#if CHANCE_SYMMETRY
+        res += sub * weight;
+#endif
+        mask &= mask - 1;
+    }
+#if CHANCE_PRUNE & 2
+    res = res / num_eval;
+#else
     res = res / num_open;
+#endif
 
-#if ENABLE_CACHE == 1
+#if SMP_TABLE
+    smp_table_set(board, state.depth_limit - state.curdepth, res);
+#elif ENABLE_CACHE == 1
     if (state.curdepth < CACHE_DEPTH_LIMIT) {
         trans_table_entry_t entry = { state.curdepth, res };
-        state.trans_table[board] = entry;
+        (*state.trans_table)[board] = entry;
     }
 #elif ENABLE_CACHE == 2
     if (state.curdepth < CACHE_DEPTH_LIMIT) {
         trans_table_entry_t entry;
         entry.depth = state.curdepth;
         entry.heuristic = res;
-        map_set(&state.trans_table, board, entry);
+        imap_set(state.trans_table, board, entry);
     }
 #endif
 
@@ -620,8 +1253,24 @@ score_heur_t Game2048::score_tilechoose_node(eval_state &state, board_t board, s
 score_heur_t Game2048::score_move_node(eval_state &state, board_t board, score_heur_t cprob) {
     score_heur_t best = 0.0f;
 
+#if SEARCH_STOP
+    if (state.stop && state.stop->stopped()) {
+        state.abandoned++;
+        return 0.0f;
+    }
+#endif
+#if OPENMP_TASK
+    if (state.curdepth < OPENMP_TASK_DEPTH) {
+        return score_move_tasks(state, board, cprob);
+    }
+#endif
     state.curdepth++;
-    for (int move = 0; move < 4; ++move) {
+    for (int i = 0; i < 4; ++i) {
+#if LAZY_SMP
+        int move = (i + state.move_offset) & 3;
+#else
+        int move = i;
+#endif
         board_t newboard = execute_move(board, move);
 
         state.moves_evaled++;
@@ -639,34 +1288,163 @@ score_heur_t Game2048::score_move_node(eval_state &state, board_t board, score_h
     return best;
 }
 
+#if OPENMP_TASK
+/* same as score_move_node, but each chance node below is an OpenMP task with its own counters */
+score_heur_t Game2048::score_move_tasks(eval_state &state, board_t board, score_heur_t cprob) {
+    eval_state child[4];
+    board_t newboard[4];
+    score_heur_t res[4];
+    score_heur_t best = 0.0f;
+    int move;
+
+    state.curdepth++;
+    for (move = 0; move < 4; ++move) {
+        newboard[move] = execute_move(board, move);
+        res[move] = 0.0f;
+        state.moves_evaled++;
+        if (board == newboard[move]) {
+            state.nomoves++;
+            continue;
+        }
+        fork_state(child[move], state);
+#pragma omp task firstprivate(move, cprob) shared(child, newboard, res)
+        res[move] = score_tilechoose_node(child[move], newboard[move], cprob);
+    }
+#pragma omp taskwait
+    /* reduce in move order, as score_move_node does */
+    for (move = 0; move < 4; ++move) {
+        if (board != newboard[move]) {
+            join_state(state, child[move]);
+            if (best < res[move]) {
+                best = res[move];
+            }
+        }
+    }
+    state.curdepth--;
+
+    return best;
+}
+
+void Game2048::fork_state(eval_state &child, const eval_state &state) {
+    child.curdepth = state.curdepth;
+    child.maxdepth = state.curdepth;
+    child.depth_limit = state.depth_limit;
+    child.cprob_thresh = state.cprob_thresh;
+#if SEARCH_STOP
+    child.stop = state.stop;
+#endif
+#if CHANCE_PRUNE
+    child.prune = state.prune;
+#endif
+}
+
+void Game2048::join_state(eval_state &state, const eval_state &child) {
+    state.maxdepth = _max(state.maxdepth, child.maxdepth);
+    state.nomoves += child.nomoves;
+    state.tablehits += child.tablehits;
+    state.cachehits += child.cachehits;
+    state.moves_evaled += child.moves_evaled;
+#if SEARCH_STOP
+    state.abandoned += child.abandoned;
+#endif
+#if CHANCE_PRUNE
+    state.pruned += child.pruned;
+    state.sampled += child.sampled;
+    state.pruned_prob += child.pruned_prob;
+#endif
+}
+#endif
+
 score_heur_t Game2048::score_toplevel_move(board_t board, int move) {
     eval_state state;
     score_heur_t res = 0.0f;
     board_t newboard = execute_move(board, move);
 
-#if ENABLE_CACHE == 2
-    map_init(&state.trans_table, NULL, NULL);
+#if ENABLE_CACHE == 1 && CACHE_ARENA
+    arena_reset(&m_cache_arena[move]);
+    trans_table_t trans_table(0, trans_table_t::hasher(), trans_table_t::key_equal(),
+        trans_table_t::allocator_type(&m_cache_arena[move]));
+    state.trans_table = &trans_table;
+#elif ENABLE_CACHE == 1
+    trans_table_t trans_table;
+    state.trans_table = &trans_table;
+#elif ENABLE_CACHE == 2
+    imap_clear(&m_trans_table[move]);
+    state.trans_table = &m_trans_table[move];
 #endif
     state.depth_limit = get_depth_limit(board);
+#if NODE_BUDGET
+    state.cprob_thresh = m_budget_cprob;
+#endif
+#if SEARCH_STOP
+    state.stop = m_stop;
+#endif
     if (board != newboard)
         res = score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
 
     printf("Move %d: result %f: eval'd %ld moves (%ld no moves, %ld table hits, %ld cache hits, %ld cache size) (maxdepth=%d)\n",
          move, res, state.moves_evaled, state.nomoves, state.tablehits, state.cachehits,
 #if ENABLE_CACHE == 1
-         (long)state.trans_table.size(),
+         (long)state.trans_table->size(),
 #elif ENABLE_CACHE == 2
-         (long)state.trans_table.base.nnodes,
+         (long)imap_size(state.trans_table),
+#elif SMP_TABLE
+         1L << LAZY_SMP_TABLE_BITS,
 #else
          0L,
 #endif
          state.maxdepth);
+#if NODE_BUDGET
+    m_root_nodes[move] = state.moves_evaled;
+#endif
+#if SEARCH_STOP
+    m_abandoned[move] = state.abandoned;
+#endif
+#if CHANCE_PRUNE
+    printf("Move %d: pruned %ld 4-tile children, sampled %ld chance nodes, %f%% probability mass approximated\n",
+         move, state.pruned, state.sampled, state.pruned_prob * 100.0f);
+#endif
+#if CHANCE_PRUNE_CHECK
+    if (board != newboard) {
+        long exact_evaled = 0;
+        score_heur_t exact = score_toplevel_exact(newboard, state.depth_limit, exact_evaled);
+
+        printf("Move %d: exact result %f: eval'd %ld moves, pruning error %f (%f%%)\n", move, exact, exact_evaled,
+             res - exact, (res - exact) * 100.0f / exact);
+    }
+#endif
+
+    return res;
+}
+
+#if CHANCE_PRUNE_CHECK
+/* same search as score_toplevel_move with pruning off, to measure the pruning error */
+score_heur_t Game2048::score_toplevel_exact(board_t newboard, int depth_limit, long &moves_evaled) {
+    eval_state state;
+    score_heur_t res = 0.0f;
+#if ENABLE_CACHE
+    /* the root move's table is still in use by the pruned search */
+    trans_table_t trans_table;
 
 #if ENABLE_CACHE == 2
-    map_delete(&state.trans_table);
+    imap_init(&trans_table);
+#endif
+    state.trans_table = &trans_table;
+#endif
+    state.depth_limit = depth_limit;
+#if NODE_BUDGET
+    state.cprob_thresh = m_budget_cprob;
+#endif
+    state.prune = 0;
+    res = score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
+    moves_evaled = state.moves_evaled;
+
+#if ENABLE_CACHE == 2
+    imap_delete(&trans_table);
 #endif
     return res;
 }
+#endif
 
 #if MULTI_THREAD
 void Game2048::thrd_worker(void *param) {
@@ -676,7 +1454,11 @@ void Game2048::thrd_worker(void *param) {
 
 #if MULTI_THREAD == 1
 static ThreadPool& get_thrd_pool() {
+#if LAZY_SMP
+    static ThreadPool thrd_pool(0);
+#else
     static ThreadPool thrd_pool(ThreadPool::get_cpu_count() >= 4 ? 4 : 0);
+#endif
     return thrd_pool;
 }
 #elif MULTI_THREAD == 2
@@ -687,51 +1469,320 @@ static THREADPOOL_CTX* get_thrd_pool() {
 #endif
 #endif
 
+#if LAZY_SMP
+void Game2048::smp_worker(void *param) {
+    smp_context *pcontext = (smp_context *)param;
+    pcontext->pthis->score_smp_root(*pcontext);
+}
+
+void Game2048::score_smp_root(smp_context &context) {
+    for (int i = 0; i < 4; ++i) {
+        int move = (i + context.helper) & 3;
+        eval_state state;
+        board_t newboard = execute_move(context.board, move);
+
+        context.res[move] = 0.0f;
+#if SEARCH_STOP
+        context.abandoned[move] = 0;
+#endif
+        if (context.first[move] != move) {
+            continue;
+        }
+        state.depth_limit = context.depth_limit;
+        state.move_offset = context.helper;
+#if NODE_BUDGET
+        state.cprob_thresh = m_budget_cprob;
+#endif
+#if SEARCH_STOP
+        state.stop = m_stop;
+#endif
+        context.res[move] = 0.0f;
+        if (context.board != newboard)
+            context.res[move] = score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
+#if SEARCH_STOP
+        context.abandoned[move] = state.abandoned;
+#endif
+
+        if (context.helper == 0) {
+            printf("Move %d: result %f: eval'd %ld moves (%ld no moves, %ld table hits, %ld cache hits, %ld cache size) (maxdepth=%d)\n",
+                 move, context.res[move], state.moves_evaled, state.nomoves, state.tablehits, state.cachehits,
+                 1L << LAZY_SMP_TABLE_BITS, state.maxdepth);
+#if NODE_BUDGET
+            m_root_nodes[move] = state.moves_evaled;
+#endif
+        }
+    }
+}
+#endif
+
+#if SMP_TABLE
+bool Game2048::smp_table_get(board_t board, int depth, score_heur_t &heuristic) {
+    smp_table_entry_t *entry = &smp_table[(board * W64LIT(0x9E3779B97F4A7C15)) >> (64 - LAZY_SMP_TABLE_BITS)];
+    board_t data = entry->data;
+    smp_heur_bits_t value;
+
+    if ((entry->check ^ data) != board || (int)(data >> 32) < depth) {
+        return false;
+    }
+    value.bits = (unsigned int)(data & W64LIT(0xFFFFFFFF));
+    heuristic = value.heuristic;
+    return true;
+}
+
+void Game2048::smp_table_set(board_t board, int depth, score_heur_t heuristic) {
+    smp_table_entry_t *entry = &smp_table[(board * W64LIT(0x9E3779B97F4A7C15)) >> (64 - LAZY_SMP_TABLE_BITS)];
+    board_t data = entry->data;
+    smp_heur_bits_t value;
+
+    /* keep a deeper result for the same board, otherwise always replace */
+    if ((entry->check ^ data) == board && (int)(data >> 32) > depth) {
+        return;
+    }
+    value.heuristic = heuristic;
+    data = (board_t)value.bits | ((board_t)depth << 32);
+    entry->check = board ^ data;
+    entry->data = data;
+}
+#endif
+
+/*
+ * first[move] is move itself when it has to be searched, an earlier move
+ * reaching the same position up to symmetry, or -1 for a no-op. Returns the
+ * number of moves to search.
+ */
+int Game2048::root_moves(board_t board, int *first) {
+    board_t newboard[4];
+    int count = 0;
+
+    for (int move = 0; move < 4; ++move) {
+        newboard[move] = execute_move(board, move);
+        first[move] = board != newboard[move] ? move : -1;
+        for (int i = 0; i < move && first[move] == move; ++i) {
+            /* only searched moves count, a no-op move may mirror the board itself */
+            if (first[i] == i && same_position(newboard[i], newboard[move])) {
+                first[move] = i;
+            }
+        }
+        if (first[move] == move) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* fill in the moves root_moves left out */
+void Game2048::finish_root_moves(const int *first, score_heur_t *res) {
+    for (int move = 0; move < 4; ++move) {
+        if (first[move] == move) {
+            continue;
+        }
+        if (first[move] < 0) {
+            res[move] = 0.0f;
+            printf("Move %d: result %f: no-op, not searched\n", move, res[move]);
+        } else {
+            res[move] = res[first[move]];
+            printf("Move %d: result %f: same position as move %d, not searched\n", move, res[move], first[move]);
+        }
+#if NODE_BUDGET
+        m_root_nodes[move] = 0;
+#endif
+    }
+}
+
+#if SEARCH_STOP
+/*
+ * zero the root moves whose search was stopped, their partial scores are
+ * lower bounds of no use for comparing moves; call before finish_root_moves.
+ * Returns the number of such moves.
+ */
+int Game2048::drop_stopped_moves(const int *first, score_heur_t *res, const long *abandoned) {
+    int count = 0, searched = 0;
+    long total = 0;
+
+    for (int move = 0; move < 4; ++move) {
+        if (first[move] != move) {
+            continue;
+        }
+        searched++;
+        if (abandoned[move] > 0) {
+            printf("Move %d: search stopped, %ld nodes abandoned\n", move, abandoned[move]);
+            res[move] = 0.0f;
+            total += abandoned[move];
+            count++;
+        }
+    }
+    if (count > 0) {
+        printf("Search stopped: %d of %d root moves unfinished, %ld nodes abandoned\n", count, searched, total);
+    }
+    return count;
+}
+#endif
+
+#if SEARCH_STOP
+int Game2048::find_best_move(board_t board, StopToken *stop) {
+#else
 int Game2048::find_best_move(board_t board) {
+#endif
     int move = 0;
     score_heur_t best = 0.0f;
     int bestmove = -1;
+    int first[4];
+#if SEARCH_STOP
+    int stopped = 0;
+
+    m_stop = stop;
+    memset(m_abandoned, 0x00, sizeof(m_abandoned));
+#endif
 
     print_board(board);
     printf("Current scores: heur %ld, actual %ld\n", (long)score_heur_board(board), (long)score_board(board));
 
-#if MULTI_THREAD
-    thrd_context context[4];
+#if LAZY_SMP
+    smp_context context[LAZY_SMP_MAX_HELPERS];
+    int helpers = 0, deepest = 0, depth_limit = get_depth_limit(board);
 #if MULTI_THREAD == 1
     ThreadPool &thrd_pool = get_thrd_pool();
+    TaskGroup group;
+    ThrdContext tasks[LAZY_SMP_MAX_HELPERS];
+    helpers = thrd_pool.get_thrd_count();
+#elif MULTI_THREAD == 2
+    THREADPOOL_CTX *ctx = get_thrd_pool();
+    THREADGROUP_CTX group = { NULL };
+    THREADTASK tasks[LAZY_SMP_MAX_HELPERS];
+    helpers = threadpool_thrdcount(ctx);
+#endif
+    helpers = _max(_min(helpers, LAZY_SMP_MAX_HELPERS), 1);
+    root_moves(board, first);
+    /* odd helpers search one ply shallower and fill the shared table for the others */
+    for (int i = 0; i < helpers; i++) {
+        context[i].pthis = this;
+        context[i].board = board;
+        context[i].helper = i;
+        context[i].depth_limit = _max(depth_limit - (i & 1), 1);
+        context[i].first = first;
+        tasks[i].func = smp_worker;
+        tasks[i].param = &context[i];
+    }
+#if MULTI_THREAD == 1
+    thrd_pool.add_tasks(tasks, helpers, &group);
+    group.wait();
+#elif MULTI_THREAD == 2
+    if (threadgroup_init(&group)) {
+        threadpool_addtasks(ctx, tasks, helpers, &group);
+        threadgroup_uninit(&group);
+    } else {
+        threadpool_addtasks(ctx, tasks, helpers, NULL);
+        threadpool_waitalltask(ctx);
+    }
+#endif
+    for (int i = 1; i < helpers; i++) {
+        if (context[i].depth_limit > context[deepest].depth_limit) {
+            deepest = i;
+        }
+    }
+#if SEARCH_STOP
+    stopped = drop_stopped_moves(first, context[deepest].res, context[deepest].abandoned);
+#endif
+    finish_root_moves(first, context[deepest].res);
     for (move = 0; move < 4; move++) {
-        context[move].pthis = this;
-        context[move].board = board;
-        context[move].move = move;
-        context[move].res = 0.0f;
-        thrd_pool.add_task(thrd_worker, &context[move]);
+        if (context[deepest].res[move] > best) {
+            best = context[deepest].res[move];
+            bestmove = move;
+        }
     }
-    thrd_pool.wait_all_task();
+#elif MULTI_THREAD
+    thrd_context context[4];
+    score_heur_t res[4];
+    int count = root_moves(board, first), ntasks = 0;
+#if MULTI_THREAD == 1
+    ThreadPool &thrd_pool = get_thrd_pool();
+    TaskGroup group;
+    ThrdContext tasks[4];
 #elif MULTI_THREAD == 2
     THREADPOOL_CTX *ctx = get_thrd_pool();
+    THREADGROUP_CTX group = { NULL };
+    THREADTASK tasks[4];
+#endif
     for (move = 0; move < 4; move++) {
         context[move].pthis = this;
         context[move].board = board;
         context[move].move = move;
         context[move].res = 0.0f;
-        threadpool_addtask(ctx, thrd_worker, &context[move]);
+        if (first[move] == move) {
+            tasks[ntasks].func = thrd_worker;
+            tasks[ntasks].param = &context[move];
+            ntasks++;
+        }
     }
-    threadpool_waitalltask(ctx);
+    if (count == 1) {
+        /*
+         * a single move left, no need to wake the pool; the search is split
+         * by root move only, so with two or three moves the rest of the
+         * pool stays idle
+         */
+        thrd_worker(tasks[0].param);
+    } else {
+#if MULTI_THREAD == 1
+        thrd_pool.add_tasks(tasks, ntasks, &group);
+        group.wait();
+#elif MULTI_THREAD == 2
+        if (threadgroup_init(&group)) {
+            threadpool_addtasks(ctx, tasks, ntasks, &group);
+            threadgroup_uninit(&group);
+        } else {
+            threadpool_addtasks(ctx, tasks, ntasks, NULL);
+            threadpool_waitalltask(ctx);
+        }
 #endif
+    }
+    for (move = 0; move < 4; move++) {
+        res[move] = context[move].res;
+    }
+#if SEARCH_STOP
+    stopped = drop_stopped_moves(first, res, m_abandoned);
+#endif
+    finish_root_moves(first, res);
     for (move = 0; move < 4; move++) {
-        if (context[move].res > best) {
-            best = context[move].res;
+        if (res[move] > best) {
+            best = res[move];
             bestmove = move;
         }
     }
 #else
     score_heur_t res[4] = { 0.0f };
+    int count = root_moves(board, first), order[4];
+    int i;
+
+    for (move = 0, i = 0; move < 4; move++) {
+        if (first[move] == move) {
+            order[i++] = move;
+        }
+    }
+#if OPENMP_TASK
+    /* one task per root move, the search spawns more below; all cores are used */
+#pragma omp parallel shared(res, order)
+    {
+#pragma omp single
+        {
+            for (i = 0; i < count; i++) {
+#pragma omp task firstprivate(i) shared(res, order)
+                res[order[i]] = score_toplevel_move(board, order[i]);
+            }
+        }
+    }
+#else
 #if OPENMP_THREAD
-#pragma omp parallel for num_threads(omp_get_num_procs() >= 4 ? 4 : omp_get_num_procs())
+    /* count is 0 when no move is legal, num_threads(0) is undefined */
+#pragma omp parallel for num_threads(_max(_min(count, omp_get_num_procs()), 1))
 #endif
-    for (move = 0; move < 4; move++) {
-        res[move] = score_toplevel_move(board, move);
+    for (i = 0; i < count; i++) {
+        res[order[i]] = score_toplevel_move(board, order[i]);
     }
+#endif
+#if SEARCH_STOP
+    stopped = drop_stopped_moves(first, res, m_abandoned);
+#endif
+    finish_root_moves(first, res);
 
     for (move = 0; move < 4; move++) {
         if (res[move] > best) {
@@ -741,6 +1792,18 @@ int Game2048::find_best_move(board_t board) {
     }
 #endif
     printf("Selected bestmove: %d, result: %f\n", bestmove, best);
+#if NODE_BUDGET && SEARCH_STOP
+    /* the node counts of a stopped search say nothing about the budget */
+    if (!stopped) {
+        update_node_budget(m_root_nodes[0] + m_root_nodes[1] + m_root_nodes[2] + m_root_nodes[3]);
+    }
+#elif NODE_BUDGET
+    update_node_budget(m_root_nodes[0] + m_root_nodes[1] + m_root_nodes[2] + m_root_nodes[3]);
+#endif
+#if SEARCH_STOP
+    (void)stopped;
+    m_stop = NULL;
+#endif
 
     return bestmove;
 }
@@ -749,6 +1812,15 @@ void Game2048::play_game() {
     board_t board = initial_board();
     int scorepenalty = 0;
     long last_score = 0, current_score = 0, moveno = 0;
+#if REPLAY_LOG
+    replay_t log;
+    char log_path[32];
+
+    sprintf(log_path, "2048-%u.rpl", m_seed);
+    if (!replay_open(&log, log_path, m_seed, board)) {
+        fprintf(stderr, "Cannot write replay log %s.\n", log_path);
+    }
+#endif
 
 #if MULTI_THREAD == 1
     ThreadPool &thrd_pool = get_thrd_pool();
@@ -759,7 +1831,11 @@ void Game2048::play_game() {
     }
 #elif MULTI_THREAD == 2
     THREADPOOL_CTX *ctx = get_thrd_pool();
+#if LAZY_SMP
+    if (!threadpool_startup(ctx, 0)) {
+#else
     if (!threadpool_startup(ctx, threadpool_cpucount() >= 4 ? 4 : 0)) {
+#endif
         fprintf(stderr, "Init thread pool failed.");
         fflush(stderr);
         abort();
@@ -797,14 +1873,63 @@ void Game2048::play_game() {
         if (tile == 2)
             scorepenalty += 4;
         board = insert_tile_rand(newboard, tile);
+#if REPLAY_LOG
+        replay_move(&log, move, board ^ newboard);
+#endif
     }
 
     print_board(board);
     printf("Game over. Your score is %ld.\n", current_score);
+#if REPLAY_LOG
+    /* the score of the final board, the line above is one move behind */
+    if (replay_close(&log, (unsigned long)(score_board(board) - scorepenalty))) {
+        printf("Replay log: %s\n", log_path);
+    }
+#endif
+#if CACHE_ARENA
+    unsigned long cache_allocs = 0, cache_mallocs = 0;
+    for (int i = 0; i < 4; ++i) {
+        cache_allocs += (unsigned long)m_cache_arena[i].nallocs;
+        cache_mallocs += (unsigned long)m_cache_arena[i].nmallocs;
+    }
+    printf("Cache arena: %lu allocations served by %lu mallocs over %ld moves.\n", cache_allocs, cache_mallocs, moveno);
+#endif
+#if MULTI_THREAD == 1
+    thrd_pool.dump_stats(stdout);
+#elif MULTI_THREAD == 2
+    threadpool_dumpstats(ctx, stdout);
+#endif
 }
 
-int main() {
+#ifndef AI_NO_MAIN
+int main(int argc, char *argv[]) {
     Game2048 obj_2048;
+    heur_weights_t weights = DEFAULT_HEUR_WEIGHTS;
+#if NTUPLE
+    const char *ntuple_path = NTUPLE_FILE;
+#endif
+
+    for (int i = 1; i < argc; ++i) {
+#if NTUPLE
+        if (strncmp(argv[i], "ntuple=", 7) == 0) {
+            ntuple_path = argv[i] + 7;
+            continue;
+        }
+#endif
+        if (!parse_heur_weight(weights, argv[i])) {
+            fprintf(stderr, "usage: %s [name=value]...\nweights: ", argv[0]);
+            print_heur_weights(stderr, DEFAULT_HEUR_WEIGHTS);
+            return 2;
+        }
+    }
+    obj_2048.set_weights(weights);
+#if NTUPLE
+    if (!obj_2048.load_ntuple(ntuple_path)) {
+        fprintf(stderr, "Cannot load n-tuple weights %s.\n", ntuple_path);
+        return 1;
+    }
+#endif
     obj_2048.play_game();
     return 0;
 }
+#endif
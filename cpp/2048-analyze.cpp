@@ -0,0 +1,345 @@
+#ifndef MULTI_THREAD
+#define MULTI_THREAD 1
+#endif
+#define AI_NO_MAIN 1
+#include "2048-ai.cpp"
+#if !REPLAY_LOG
+#include "replay.c"
+#endif
+
+#if MULTI_THREAD != 1 || LAZY_SMP || OPENMP_TASK || NODE_BUDGET || NTUPLE
+#error "2048-analyze needs MULTI_THREAD=1 and does not support LAZY_SMP, OPENMP_TASK, NODE_BUDGET or NTUPLE."
+#endif
+
+/* positions per thread pool task */
+#define ANALYZE_CHUNK 16
+
+typedef struct {
+    board_t board;
+    int game;
+    int moveno;
+    int played;
+    int best;
+    score_heur_t res[4];
+} position_t;
+
+/*
+ * Re-searches every position of replay logs with the AI and flags the moves
+ * that score worse than the best one by more than a margin. All threads share
+ * the tables of one Game2048, each task has its own eval_state and cache.
+ */
+class Analyze2048 {
+public:
+    Analyze2048(int depth, double margin, const heur_weights_t &weights);
+    ~Analyze2048();
+
+    bool load(const char *path);
+    void run(int threads);
+    void report();
+
+private:
+    typedef struct {
+        Analyze2048 *pthis;
+        long begin;
+        long end;
+    } chunk_context;
+
+    static void chunk_worker(void *param);
+    void analyze_chunk(long begin, long end);
+    score_heur_t score_move(Game2048::eval_state &state, board_t board, int move);
+    bool add_position(board_t board, int moveno, int played);
+    bool add_game(const char *path);
+
+    Game2048 m_game;
+    position_t *m_positions;
+    long m_count;
+    long m_capacity;
+    char **m_names;
+    int m_games;
+    int m_names_capacity;
+    unsigned char *m_data;
+    size_t m_data_capacity;
+    int m_depth;
+    double m_margin;
+    int m_threads;
+    double m_seconds;
+};
+
+static const char *move_names[4] = { "up", "down", "left", "right" };
+
+Analyze2048::Analyze2048(int depth, double margin, const heur_weights_t &weights):m_positions(NULL), m_count(0), m_capacity(0), m_names(NULL), m_games(0),
+    m_names_capacity(0), m_data(NULL), m_data_capacity(0), m_depth(depth), m_margin(margin), m_threads(0), m_seconds(0.0) {
+    /* weights first, init_tables() keeps the table they built */
+    m_game.set_weights(weights);
+    m_game.init_tables();
+}
+
+Analyze2048::~Analyze2048() {
+    for (int i = 0; i < m_games; ++i) {
+        free(m_names[i]);
+    }
+    free(m_names);
+    free(m_positions);
+    free(m_data);
+}
+
+bool Analyze2048::add_position(board_t board, int moveno, int played) {
+    if (m_count == m_capacity) {
+        long capacity = m_capacity ? m_capacity * 2 : 4096;
+        position_t *positions = (position_t *)realloc(m_positions, capacity * sizeof(position_t));
+
+        if (!positions) {
+            return false;
+        }
+        m_positions = positions;
+        m_capacity = capacity;
+    }
+    m_positions[m_count].board = board;
+    m_positions[m_count].game = m_games;
+    m_positions[m_count].moveno = moveno;
+    m_positions[m_count].played = played;
+    m_positions[m_count].best = -1;
+    m_count++;
+    return true;
+}
+
+bool Analyze2048::add_game(const char *path) {
+    char *name = NULL;
+
+    if (m_games == m_names_capacity) {
+        int capacity = m_names_capacity ? m_names_capacity * 2 : 64;
+        char **names = (char **)realloc(m_names, capacity * sizeof(char *));
+
+        if (!names) {
+            return false;
+        }
+        m_names = names;
+        m_names_capacity = capacity;
+    }
+    name = (char *)malloc(strlen(path) + 1);
+    if (!name) {
+        return false;
+    }
+    strcpy(name, path);
+    m_names[m_games++] = name;
+    return true;
+}
+
+bool Analyze2048::load(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    replay_info_t info;
+    board_t board = 0;
+    long size = -1;
+    bool ret = false;
+
+    if (!fp) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        size = ftell(fp);
+    }
+    if (size >= 0 && fseek(fp, 0, SEEK_SET) == 0 && (size_t)size > m_data_capacity) {
+        unsigned char *data = (unsigned char *)realloc(m_data, (size_t)size);
+
+        if (data) {
+            m_data = data;
+            m_data_capacity = (size_t)size;
+        } else {
+            size = -1;
+        }
+    }
+    if (size < 0 || fread(m_data, 1, (size_t)size, fp) != (size_t)size) {
+        printf("%s: cannot read\n", path);
+    } else if (!replay_parse(m_data, (size_t)size, &info)) {
+        printf("%s: not a replay log\n", path);
+    } else {
+        ret = true;
+        board = info.board;
+        for (unsigned long i = 0; i < info.nmoves && ret; ++i) {
+            unsigned int rec = info.moves[i];
+            int shift = REPLAY_CELL(rec) << 2;
+            board_t newboard = m_game.execute_move(board, REPLAY_MOVE(rec));
+
+            if (newboard == board || ((newboard >> shift) & 0xf)) {
+                printf("%s: move %lu cannot be replayed\n", path, i + 1);
+                ret = false;
+            } else if (!add_position(board, (int)i + 1, REPLAY_MOVE(rec))) {
+                printf("Not enough memory.\n");
+                ret = false;
+            }
+            board = newboard | ((board_t)REPLAY_TILE(rec) << shift);
+        }
+        if (ret && !add_game(path)) {
+            printf("Not enough memory.\n");
+            ret = false;
+        }
+        if (!ret) {
+            /* drop the positions of this game */
+            while (m_count > 0 && m_positions[m_count - 1].game == m_games) {
+                m_count--;
+            }
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+score_heur_t Analyze2048::score_move(Game2048::eval_state &state, board_t board, int move) {
+    board_t newboard = m_game.execute_move(board, move);
+
+    state.depth_limit = m_depth > 0 ? m_depth : m_game.get_depth_limit(board);
+    return m_game.score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
+}
+
+void Analyze2048::analyze_chunk(long begin, long end) {
+#if ENABLE_CACHE
+    trans_table_t trans_table;
+
+#if ENABLE_CACHE == 2
+    imap_init(&trans_table);
+#endif
+#endif
+    for (long i = begin; i < end; ++i) {
+        position_t &pos = m_positions[i];
+        int first[4];
+
+        m_game.root_moves(pos.board, first);
+        for (int move = 0; move < 4; ++move) {
+            Game2048::eval_state state;
+
+            if (first[move] != move) {
+                pos.res[move] = first[move] < 0 ? 0.0f : pos.res[first[move]];
+                continue;
+            }
+#if ENABLE_CACHE == 1
+            trans_table.clear();
+            state.trans_table = &trans_table;
+#elif ENABLE_CACHE == 2
+            imap_clear(&trans_table);
+            state.trans_table = &trans_table;
+#endif
+            pos.res[move] = score_move(state, pos.board, move);
+        }
+        pos.best = 0;
+        for (int move = 1; move < 4; ++move) {
+            if (pos.res[move] > pos.res[pos.best]) {
+                pos.best = move;
+            }
+        }
+    }
+#if ENABLE_CACHE == 2
+    imap_delete(&trans_table);
+#endif
+}
+
+void Analyze2048::chunk_worker(void *param) {
+    chunk_context *pcontext = (chunk_context *)param;
+    pcontext->pthis->analyze_chunk(pcontext->begin, pcontext->end);
+}
+
+void Analyze2048::run(int threads) {
+    ThreadPool thrd_pool(threads);
+    TaskGroup group;
+    long nchunks = (m_count + ANALYZE_CHUNK - 1) / ANALYZE_CHUNK;
+    chunk_context *context = (chunk_context *)malloc((nchunks + 1) * sizeof(chunk_context));
+    ThrdContext *tasks = (ThrdContext *)malloc((nchunks + 1) * sizeof(ThrdContext));
+    time_t start = time(NULL);
+
+    if (!context || !tasks || !thrd_pool.init()) {
+        fprintf(stderr, "Init thread pool failed.");
+        fflush(stderr);
+        abort();
+    }
+    for (long i = 0; i < nchunks; ++i) {
+        context[i].pthis = this;
+        context[i].begin = i * ANALYZE_CHUNK;
+        context[i].end = _min(m_count, (i + 1) * ANALYZE_CHUNK);
+        tasks[i].func = chunk_worker;
+        tasks[i].param = &context[i];
+    }
+    thrd_pool.add_tasks(tasks, (int)nchunks, &group);
+    group.wait();
+    m_threads = thrd_pool.get_thrd_count();
+    m_seconds = difftime(time(NULL), start);
+    free(tasks);
+    free(context);
+}
+
+void Analyze2048::report() {
+    long flagged = 0, agreed = 0;
+    long i = 0;
+
+    for (int game = 0; game < m_games; ++game) {
+        long positions = 0, game_flagged = 0, game_agreed = 0;
+
+        for (; i < m_count && m_positions[i].game == game; ++i) {
+            const position_t &pos = m_positions[i];
+            score_heur_t best = pos.res[pos.best], played = pos.res[pos.played];
+            double loss = best > 0.0f ? (best - played) / best : 0.0;
+
+            positions++;
+            if (pos.res[pos.played] == best) {
+                game_agreed++;
+            }
+            if (loss > m_margin) {
+                game_flagged++;
+                printf("%s move %d: played %s %f, best %s %f, %.3f%% worse\n", m_names[game], pos.moveno,
+                     move_names[pos.played], played, move_names[pos.best], best, loss * 100.0);
+            }
+        }
+        printf("%s: %ld positions, %ld agree with the search (%.1f%%), %ld flagged\n", m_names[game], positions,
+             game_agreed, positions ? game_agreed * 100.0 / positions : 0.0, game_flagged);
+        flagged += game_flagged;
+        agreed += game_agreed;
+    }
+    printf("%d games, %ld positions, %ld agree with the search, %ld flagged (margin %.3f%%, depth %s)\n", m_games, m_count,
+         agreed, flagged, m_margin * 100.0, m_depth > 0 ? "fixed" : "by tiles");
+    printf("Searched with %d threads in %.0fs", m_threads, m_seconds);
+    if (m_seconds > 0.0) {
+        printf(" (%.1f positions/s)", m_count / m_seconds);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int depth = 0, threads = 0, loaded = 0, i = 1;
+    double margin = 0.01;
+    heur_weights_t weights = DEFAULT_HEUR_WEIGHTS;
+
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-d") == 0) {
+            depth = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            margin = atof(argv[i + 1]) / 100.0;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            threads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-w") == 0) {
+            if (!parse_heur_weight(weights, argv[i + 1])) {
+                fprintf(stderr, "bad weight %s, weights: ", argv[i + 1]);
+                print_heur_weights(stderr, DEFAULT_HEUR_WEIGHTS);
+                return 2;
+            }
+        } else {
+            break;
+        }
+    }
+    if (i >= argc) {
+        fprintf(stderr, "usage: %s [-d depth] [-m margin%%] [-t threads] [-w name=value]... log...\n", argv[0]);
+        return 2;
+    }
+
+    Analyze2048 obj_analyze(depth, margin, weights);
+
+    for (; i < argc; ++i) {
+        if (obj_analyze.load(argv[i])) {
+            loaded++;
+        }
+    }
+    if (loaded == 0) {
+        return 1;
+    }
+    obj_analyze.run(threads);
+    obj_analyze.report();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#define AI_NO_MAIN 1
+#include "2048-ai.cpp"
+
+/* random boards of each kind, the fixed ones below are always checked */
+#define CHECK_BOARDS 20000
+
+/* boards that are their own mirror image once a move is made */
+static const board_t check_fixed_boards[] = {
+    0x4321ULL,
+    0x1234ULL,
+    0x4321000000000000ULL,
+    0x0001000200030004ULL,
+    0x1000200030004000ULL,
+    0x1111ULL,
+    0x1221000000000000ULL,
+    0x0000000012344321ULL,
+};
+
+/*
+ * Self-checks of search invariants that the fixed-seed game output does not
+ * show. Prints every failure and exits with 1 when there was one.
+ */
+class Check2048 {
+public:
+    Check2048() : m_boards(0), m_failures(0) {
+        m_game.init_tables();
+    }
+
+    int run();
+
+private:
+    void check_root_moves(board_t board);
+    void fail(board_t board, int move, const char *what);
+    board_t random_row();
+    board_t mirrored_row();
+
+    Game2048 m_game;
+    long m_boards;
+    long m_failures;
+};
+
+void Check2048::fail(board_t board, int move, const char *what) {
+    printf("root_moves: board %08lx%08lx move %d: %s\n",
+        (unsigned long)(board >> 32), (unsigned long)(board & 0xFFFFFFFFUL), move, what);
+    m_failures++;
+}
+
+/* every searched move is its own first, every other move names one */
+void Check2048::check_root_moves(board_t board) {
+    int first[4], searched = 0, legal = 0;
+    int count = m_game.root_moves(board, first);
+
+    m_boards++;
+    for (int move = 0; move < 4; ++move) {
+        board_t newboard = m_game.execute_move(board, move);
+
+        if (newboard != board) {
+            legal++;
+        }
+        if (first[move] < 0) {
+            if (newboard != board) {
+                fail(board, move, "a legal move is marked as a no-op");
+            }
+        } else if (newboard == board) {
+            fail(board, move, "a no-op is not marked");
+        } else if (first[move] == move) {
+            searched++;
+        } else if (first[move] > move || first[first[move]] != first[move]) {
+            fail(board, move, "points to a move that is not searched");
+        } else if (!m_game.same_position(m_game.execute_move(board, first[move]), newboard)) {
+            fail(board, move, "points to a different position");
+        }
+    }
+    if (searched != count) {
+        fail(board, -1, "count differs from the searched moves");
+    }
+    if (legal > 0 && count == 0) {
+        fail(board, -1, "no move searched");
+    }
+}
+
+board_t Check2048::random_row() {
+    return (board_t)(rand() & 0xFF) | ((board_t)(rand() & 0xFF) << 8);
+}
+
+/* the same tiles read from either end */
+board_t Check2048::mirrored_row() {
+    row_t half = (row_t)(rand() & 0xFF);
+
+    return (board_t)(half | m_game.reverse_row(half));
+}
+
+int Check2048::run() {
+    size_t i;
+
+    for (i = 0; i < sizeof(check_fixed_boards) / sizeof(check_fixed_boards[0]); ++i) {
+        check_root_moves(check_fixed_boards[i]);
+    }
+    srand(1);
+    for (i = 0; i < CHECK_BOARDS; ++i) {
+        board_t a = random_row(), b = random_row();
+
+        /* mirrored top to bottom, left to right, and neither */
+        check_root_moves(a | (b << 16) | (b << 32) | (a << 48));
+        check_root_moves(mirrored_row() | (mirrored_row() << 16) | (mirrored_row() << 32) | (mirrored_row() << 48));
+        check_root_moves(a | (b << 16) | (random_row() << 32) | (random_row() << 48));
+    }
+    printf("%ld boards checked, %ld failures\n", m_boards, m_failures);
+    return m_failures > 0 ? 1 : 0;
+}
+
+int main() {
+    Check2048 check;
+
+    return check.run();
+}
@@ -0,0 +1,355 @@
+#ifndef MULTI_THREAD
+#define MULTI_THREAD 1
+#endif
+#define AI_NO_MAIN 1
+#undef SEARCH_STOP
+#define SEARCH_STOP 1
+#include "2048-ai.cpp"
+#include "history.c"
+
+#if MULTI_THREAD != 1 || LAZY_SMP || OPENMP_TASK || NODE_BUDGET || NTUPLE
+#error "2048-hint needs MULTI_THREAD=1 and does not support LAZY_SMP, OPENMP_TASK, NODE_BUDGET or NTUPLE."
+#endif
+
+#if defined(UNIX_LIKE)
+#include <sys/select.h>
+#endif
+
+/* same file as cpp/2048.cpp with GAME_HISTORY=1, a game can be continued with or without hints */
+#ifndef HISTORY_FILE
+#define HISTORY_FILE "2048.hst"
+#endif
+
+/* how often the screen is refreshed with new results while waiting for a key */
+#define HINT_POLL_MS 50
+
+enum {
+    HINT_QUIT = -1,
+    HINT_NONE = 0,
+    HINT_MOVED,
+};
+
+/*
+ * The interactive game with the AI as an adviser: while the player thinks,
+ * the thread pool searches each root move of the position and the scores
+ * are shown as they come in. A key that changes the position stops the
+ * search through its StopToken; the pool threads drop their subtrees at the
+ * next move or chance node and are free for the next position, so the game
+ * never waits for a search to finish.
+ */
+class Hint2048 {
+public:
+    Hint2048();
+
+    void play();
+
+private:
+    typedef struct {
+        Hint2048 *pthis;
+        board_t board;
+        int move;
+        score_heur_t res;
+        StopToken *stop;
+        long abandoned;
+        volatile int done;
+    } task_context;
+
+    static void task_worker(void *param);
+    score_heur_t score_move(board_t board, int move, StopToken *stop, long &abandoned);
+    void start_search(board_t board, StopToken &stop, TaskGroup &group);
+    void stop_search(StopToken &stop, TaskGroup &group);
+    int ready();
+    void draw(board_t board, long moveno, long score, long last_score);
+    int handle_key(int key, history_t &history);
+    bool has_moves(board_t board);
+
+    Game2048 m_game;
+    ThreadPool m_pool;
+    task_context m_context[4];
+    int m_first[4];
+    int m_searched;
+    long m_searches;
+    long m_stopped;
+    long m_abandoned;
+};
+
+static const char *hint_move_names[4] = { "up", "down", "left", "right" };
+
+/* a key, -1 when none came within ms milliseconds; the end of the input quits */
+static int get_key(int ms) {
+#if defined(_WIN32) && !defined(NOT_USE_WIN32_SDK)
+    for (; ms > 0; ms -= 10) {
+        if (_kbhit()) {
+            return _getch();
+        }
+        Sleep(10);
+    }
+    return _kbhit() ? _getch() : -1;
+#elif defined(UNIX_LIKE)
+    struct termios old_termios, new_termios;
+    struct timeval tv;
+    fd_set fds;
+    int ret = -1, error = 0;
+    char c;
+
+    fflush(stdout);
+    error = tcgetattr(0, &old_termios);
+    new_termios = old_termios;
+    new_termios.c_lflag &= ~(ICANON | ECHO);
+    new_termios.c_cc[VMIN] = 1;
+    new_termios.c_cc[VTIME] = 0;
+    if (error == 0) {
+        tcsetattr(0, TCSANOW, &new_termios);
+    }
+    FD_ZERO(&fds);
+    FD_SET(0, &fds);
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    if (select(1, &fds, NULL, NULL, &tv) > 0) {
+        ret = read(0, &c, 1) == 1 ? (unsigned char)c : 'q';
+    }
+    if (error == 0) {
+        tcsetattr(0, TCSANOW, &old_termios);
+    }
+    return ret;
+#else
+    (void)ms;
+    return getchar();
+#endif
+}
+
+Hint2048::Hint2048():m_pool(0), m_searched(0), m_searches(0), m_stopped(0), m_abandoned(0) {
+    m_game.init_tables();
+    memset(m_context, 0x00, sizeof(m_context));
+    if (!m_pool.init()) {
+        fprintf(stderr, "Init thread pool failed.");
+        fflush(stderr);
+        abort();
+    }
+}
+
+bool Hint2048::has_moves(board_t board) {
+    for (int move = 0; move < 4; ++move) {
+        if (m_game.execute_move(board, move) != board) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* same search as Game2048::score_toplevel_move(), quiet and with a cache per task */
+score_heur_t Hint2048::score_move(board_t board, int move, StopToken *stop, long &abandoned) {
+    Game2048::eval_state state;
+    board_t newboard = m_game.execute_move(board, move);
+    score_heur_t res = 0.0f;
+#if ENABLE_CACHE == 1
+    trans_table_t trans_table;
+
+    state.trans_table = &trans_table;
+#elif ENABLE_CACHE == 2
+    trans_table_t trans_table;
+
+    imap_init(&trans_table);
+    state.trans_table = &trans_table;
+#endif
+    state.depth_limit = m_game.get_depth_limit(board);
+    state.stop = stop;
+    res = m_game.score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
+#if ENABLE_CACHE == 2
+    imap_delete(&trans_table);
+#endif
+    abandoned = state.abandoned;
+    return res;
+}
+
+void Hint2048::task_worker(void *param) {
+    task_context *pcontext = (task_context *)param;
+    score_heur_t res = pcontext->pthis->score_move(pcontext->board, pcontext->move, pcontext->stop, pcontext->abandoned);
+
+    /* a stopped search returns early with a partial score, drop it */
+    if (pcontext->abandoned == 0) {
+        pcontext->res = res;
+        pcontext->done = 1;
+    }
+}
+
+void Hint2048::start_search(board_t board, StopToken &stop, TaskGroup &group) {
+    ThrdContext tasks[4];
+    int ntasks = 0;
+
+    m_searched = m_game.root_moves(board, m_first);
+    for (int move = 0; move < 4; ++move) {
+        m_context[move].pthis = this;
+        m_context[move].board = board;
+        m_context[move].move = move;
+        m_context[move].res = 0.0f;
+        m_context[move].stop = &stop;
+        m_context[move].abandoned = 0;
+        m_context[move].done = 0;
+        if (m_first[move] == move) {
+            tasks[ntasks].func = task_worker;
+            tasks[ntasks].param = &m_context[move];
+            ntasks++;
+        }
+    }
+    m_pool.add_tasks(tasks, ntasks, &group);
+    m_searches++;
+}
+
+/* returns once every task of the search has left the pool */
+void Hint2048::stop_search(StopToken &stop, TaskGroup &group) {
+    long abandoned = 0;
+
+    stop.stop();
+    group.wait();
+    for (int move = 0; move < 4; ++move) {
+        if (m_first[move] == move) {
+            abandoned += m_context[move].abandoned;
+        }
+    }
+    if (abandoned > 0) {
+        m_stopped++;
+        m_abandoned += abandoned;
+    }
+}
+
+/* number of root moves with a result */
+int Hint2048::ready() {
+    int count = 0;
+
+    for (int move = 0; move < 4; ++move) {
+        if (m_first[move] == move && m_context[move].done) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void Hint2048::draw(board_t board, long moveno, long score, long last_score) {
+    int best = -1;
+
+    clear_screen();
+    printf("Move #%ld, current score=%ld(+%ld)\n", moveno, score, score - last_score);
+    m_game.print_board(board);
+    printf("Hint:");
+    for (int move = 0; move < 4; ++move) {
+        const task_context &context = m_context[m_first[move] < 0 ? move : m_first[move]];
+
+        if (m_first[move] < 0) {
+            printf(" %s -", hint_move_names[move]);
+        } else if (!context.done) {
+            printf(" %s ...", hint_move_names[move]);
+        } else {
+            printf(" %s %.0f", hint_move_names[move], context.res);
+            if (best < 0 || context.res > m_context[m_first[best]].res) {
+                best = move;
+            }
+        }
+    }
+    printf("\n");
+    if (ready() == m_searched && best >= 0) {
+        printf("Best move: %s\n", hint_move_names[best]);
+    }
+    fflush(stdout);
+}
+
+/* HINT_MOVED when the key changed the position */
+int Hint2048::handle_key(int key, history_t &history) {
+    const char *allmoves = "wsadkjhl", *pos = NULL;
+    board_t board = history_board(&history), newboard = 0;
+    long scorepenalty = (long)history_penalty(&history);
+    unsigned long moves = history_moves(&history);
+    row_t tile = 0;
+
+    if (key == 'q') {
+        return HINT_QUIT;
+    } else if (key == 'r') {
+        return history_undo(&history) ? HINT_MOVED : HINT_NONE;
+    } else if (key == 'f') {
+        return history_redo(&history) ? HINT_MOVED : HINT_NONE;
+    }
+    pos = key > 0 ? strchr(allmoves, key) : NULL;
+    if (!pos) {
+        return HINT_NONE;
+    }
+    newboard = m_game.execute_move(board, (int)(pos - allmoves) % 4);
+    if (newboard == board) {
+        return HINT_NONE;
+    }
+    tile = m_game.draw_tile();
+    if (tile == 2) {
+        scorepenalty += 4;
+    }
+    newboard = m_game.insert_tile_rand(newboard, tile);
+    if (!history_push(&history, newboard, (unsigned long)scorepenalty)) {
+        fprintf(stderr, "Cannot write history %s, undo is kept in memory.\n", HISTORY_FILE ? HISTORY_FILE : "");
+        /* a failed write may have recorded the position in memory already */
+        if (!history_detach(&history) ||
+            (history_moves(&history) == moves && !history_push(&history, newboard, (unsigned long)scorepenalty))) {
+            fprintf(stderr, "Not enough memory.");
+            fflush(stderr);
+            abort();
+        }
+    }
+    return HINT_MOVED;
+}
+
+void Hint2048::play() {
+    history_t history;
+    board_t board = m_game.initial_board();
+    long last_score = 0, current_score = 0;
+    int action = HINT_NONE;
+
+    if (!history_open(&history, HISTORY_FILE, board)) {
+        fprintf(stderr, "Cannot open history %s, undo is kept in memory.\n", HISTORY_FILE ? HISTORY_FILE : "");
+        if (!history_open(&history, NULL, board)) {
+            fprintf(stderr, "Not enough memory.");
+            fflush(stderr);
+            abort();
+        }
+    }
+    if (!has_moves(history_board(&history))) {
+        history_reset(&history, board);
+    }
+    while (action != HINT_QUIT) {
+        /* the token outlives the tasks: group waits for them first when leaving the scope */
+        StopToken stop;
+        TaskGroup group;
+        long moveno = (long)history_moves(&history) + 1;
+        int shown = -1;
+
+        board = history_board(&history);
+        current_score = (long)(m_game.score_board(board) - history_penalty(&history));
+        if (!has_moves(board)) {
+            break;
+        }
+        start_search(board, stop, group);
+        for (action = HINT_NONE; action == HINT_NONE;) {
+            int key = 0;
+
+            if (ready() != shown) {
+                shown = ready();
+                draw(board, moveno, current_score, last_score);
+            }
+            key = get_key(HINT_POLL_MS);
+            if (key >= 0) {
+                action = handle_key(key, history);
+            }
+        }
+        stop_search(stop, group);
+        last_score = current_score;
+    }
+
+    clear_screen();
+    m_game.print_board(board);
+    printf("Game over. Your score is %ld.\n", current_score);
+    printf("%ld searches, %ld stopped early, %ld nodes abandoned.\n", m_searches, m_stopped, m_abandoned);
+    history_close(&history);
+}
+
+int main() {
+    Hint2048 obj_hint;
+
+    obj_hint.play();
+    return 0;
+}
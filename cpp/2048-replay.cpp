@@ -0,0 +1,357 @@
+#define SUPPORT_64BIT 1
+#define AI_SOURCE 1
+#define NO_CLEAR_SCREEN 1
+#include "arch.h"
+#include "replay.c"
+
+enum {
+    UP = 0,
+    DOWN,
+    LEFT,
+    RIGHT,
+};
+
+/* replays logs written by 2048-ai with REPLAY_LOG, checks them and collects statistics */
+class Replay2048 {
+public:
+    Replay2048();
+    ~Replay2048();
+
+    bool verify_file(const char *path, bool verbose);
+    void print_summary();
+
+private:
+    inline board_t unpack_col(row_t row) {
+        board_t tmp = row;
+        return (tmp | (tmp << 12) | (tmp << 24) | (tmp << 36)) & COL_MASK;
+    }
+    inline row_t reverse_row(row_t row) {
+        return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12);
+    }
+    board_t transpose(board_t x);
+    int max_rank(board_t board);
+
+    void init_tables();
+    board_t execute_move(board_t board, int move);
+    score_t score_board(board_t board);
+    bool replay(const char *path, const replay_info_t &info, bool verbose);
+
+#define TABLESIZE 65536
+    row_t *row_left_table;
+    row_t *row_right_table;
+    score_t *score_table;
+
+    unsigned char *m_data;
+    size_t m_capacity;
+
+    long m_logs;
+    long m_verified;
+    long m_failed;
+    long m_unfinished;
+    double m_moves;
+    double m_score_sum;
+    unsigned long m_score_min;
+    unsigned long m_score_max;
+    double m_bytes;
+    double m_replay_seconds;
+    long m_spawns[3];
+    long m_spawn_cells[16];
+    long m_max_tiles[16];
+};
+
+Replay2048::Replay2048():m_data(NULL), m_capacity(0), m_logs(0), m_verified(0), m_failed(0), m_unfinished(0), m_moves(0.0),
+    m_score_sum(0.0), m_score_min(0), m_score_max(0), m_bytes(0.0), m_replay_seconds(0.0) {
+    row_left_table = (row_t *)malloc(sizeof(row_t) * TABLESIZE);
+    row_right_table = (row_t *)malloc(sizeof(row_t) * TABLESIZE);
+    score_table = (score_t *)malloc(sizeof(score_t) * TABLESIZE);
+    if (!row_left_table || !row_right_table || !score_table) {
+        fprintf(stderr, "Not enough memory.");
+        fflush(stderr);
+        abort();
+    }
+    memset(m_spawns, 0x00, sizeof(m_spawns));
+    memset(m_spawn_cells, 0x00, sizeof(m_spawn_cells));
+    memset(m_max_tiles, 0x00, sizeof(m_max_tiles));
+    init_tables();
+}
+
+Replay2048::~Replay2048() {
+    free(row_left_table);
+    free(row_right_table);
+    free(score_table);
+    free(m_data);
+}
+
+board_t Replay2048::transpose(board_t x) {
+    board_t a1 = x & W64LIT(0xF0F00F0FF0F00F0F);
+    board_t a2 = x & W64LIT(0x0000F0F00000F0F0);
+    board_t a3 = x & W64LIT(0x0F0F00000F0F0000);
+    board_t a = a1 | (a2 << 12) | (a3 >> 12);
+    board_t b1 = a & W64LIT(0xFF00FF0000FF00FF);
+    board_t b2 = a & W64LIT(0x00FF00FF00000000);
+    board_t b3 = a & W64LIT(0x00000000FF00FF00);
+
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+int Replay2048::max_rank(board_t board) {
+    int rank = 0;
+
+    while (board) {
+        if ((int)(board & 0xf) > rank) {
+            rank = (int)(board & 0xf);
+        }
+        board >>= 4;
+    }
+    return rank;
+}
+
+void Replay2048::init_tables() {
+    row_t row = 0, result = 0;
+    row_t rev_row = 0, rev_result = 0;
+
+    do {
+        int i = 0, j = 0;
+        row_t line[4] = { 0 };
+        score_t score = 0;
+
+        line[0] = row & 0xf;
+        line[1] = (row >> 4) & 0xf;
+        line[2] = (row >> 8) & 0xf;
+        line[3] = (row >> 12) & 0xf;
+
+        for (i = 0; i < 4; ++i) {
+            score_t rank = line[i];
+
+            if (rank >= 2) {
+                score += (rank - 1) * (1 << rank);
+            }
+        }
+        score_table[row] = score;
+
+        for (i = 0; i < 3; ++i) {
+            for (j = i + 1; j < 4; ++j) {
+                if (line[j] != 0)
+                    break;
+            }
+            if (j == 4)
+                break;
+
+            if (line[i] == 0) {
+                line[i] = line[j];
+                line[j] = 0;
+                i--;
+            } else if (line[i] == line[j]) {
+                if (line[i] != 0xf) {
+                    line[i]++;
+                }
+                line[j] = 0;
+            }
+        }
+
+        result = line[0] | (line[1] << 4) | (line[2] << 8) | (line[3] << 12);
+
+        rev_row = reverse_row(row);
+        rev_result = reverse_row(result);
+        row_left_table[row] = row ^ result;
+        row_right_table[rev_row] = rev_row ^ rev_result;
+    } while (row++ != 0xFFFF);
+}
+
+board_t Replay2048::execute_move(board_t board, int move) {
+    board_t ret = board;
+
+    if (move == UP) {
+        board = transpose(board);
+        ret ^= unpack_col(row_left_table[board & ROW_MASK]);
+        ret ^= unpack_col(row_left_table[(board >> 16) & ROW_MASK]) << 4;
+        ret ^= unpack_col(row_left_table[(board >> 32) & ROW_MASK]) << 8;
+        ret ^= unpack_col(row_left_table[(board >> 48) & ROW_MASK]) << 12;
+    } else if (move == DOWN) {
+        board = transpose(board);
+        ret ^= unpack_col(row_right_table[board & ROW_MASK]);
+        ret ^= unpack_col(row_right_table[(board >> 16) & ROW_MASK]) << 4;
+        ret ^= unpack_col(row_right_table[(board >> 32) & ROW_MASK]) << 8;
+        ret ^= unpack_col(row_right_table[(board >> 48) & ROW_MASK]) << 12;
+    } else if (move == LEFT) {
+        ret ^= (board_t)(row_left_table[board & ROW_MASK]);
+        ret ^= (board_t)(row_left_table[(board >> 16) & ROW_MASK]) << 16;
+        ret ^= (board_t)(row_left_table[(board >> 32) & ROW_MASK]) << 32;
+        ret ^= (board_t)(row_left_table[(board >> 48) & ROW_MASK]) << 48;
+    } else if (move == RIGHT) {
+        ret ^= (board_t)(row_right_table[board & ROW_MASK]);
+        ret ^= (board_t)(row_right_table[(board >> 16) & ROW_MASK]) << 16;
+        ret ^= (board_t)(row_right_table[(board >> 32) & ROW_MASK]) << 32;
+        ret ^= (board_t)(row_right_table[(board >> 48) & ROW_MASK]) << 48;
+    }
+    return ret;
+}
+
+score_t Replay2048::score_board(board_t board) {
+    return score_table[board & ROW_MASK] + score_table[(board >> 16) & ROW_MASK] +
+        score_table[(board >> 32) & ROW_MASK] + score_table[(board >> 48) & ROW_MASK];
+}
+
+bool Replay2048::replay(const char *path, const replay_info_t &info, bool verbose) {
+    board_t board = info.board;
+    unsigned long score = 0, penalty = 0;
+    long spawns[3] = { 0 };
+    long spawn_cells[16] = { 0 };
+    int move = 0;
+
+    for (unsigned long i = 0; i < info.nmoves; ++i) {
+        unsigned int rec = info.moves[i];
+        int shift = REPLAY_CELL(rec) << 2;
+        board_t newboard = execute_move(board, REPLAY_MOVE(rec));
+
+        if (newboard == board) {
+            printf("%s: move %lu does not change the board\n", path, i + 1);
+            return false;
+        }
+        if ((newboard >> shift) & 0xf) {
+            printf("%s: move %lu inserts a tile on an occupied cell\n", path, i + 1);
+            return false;
+        }
+        board = newboard | ((board_t)REPLAY_TILE(rec) << shift);
+        spawns[REPLAY_TILE(rec)]++;
+        spawn_cells[REPLAY_CELL(rec)]++;
+    }
+    penalty = 4 * (unsigned long)spawns[2];
+    score = score_board(board) - penalty;
+
+    if (info.finished) {
+        for (move = 0; move < 4; move++) {
+            if (execute_move(board, move) != board)
+                break;
+        }
+        if (move < 4) {
+            printf("%s: game marked finished but move %d is still possible\n", path, move);
+            return false;
+        }
+        if (info.final_moves != info.nmoves || info.final_score != score) {
+            printf("%s: logged %lu moves, score %lu, replayed %lu moves, score %lu\n", path,
+                 info.final_moves, info.final_score, info.nmoves, score);
+            return false;
+        }
+    } else {
+        m_unfinished++;
+    }
+
+    m_moves += info.nmoves;
+    m_score_sum += score;
+    if (m_verified == 0 || score < m_score_min) {
+        m_score_min = score;
+    }
+    if (score > m_score_max) {
+        m_score_max = score;
+    }
+    m_verified++;
+    m_max_tiles[max_rank(board)]++;
+    for (int i = 1; i <= 2; ++i) {
+        m_spawns[i] += spawns[i];
+    }
+    for (int i = 0; i < 16; ++i) {
+        m_spawn_cells[i] += spawn_cells[i];
+    }
+    if (verbose) {
+        printf("%s: seed %lu, %lu moves, score %lu, max tile %u%s\n", path, info.seed, info.nmoves, score,
+             1U << max_rank(board), info.finished ? "" : ", unfinished");
+    }
+    return true;
+}
+
+bool Replay2048::verify_file(const char *path, bool verbose) {
+    FILE *fp = fopen(path, "rb");
+    replay_info_t info;
+    long size = 0;
+    bool ret = false;
+    clock_t start;
+
+    m_logs++;
+    if (!fp) {
+        printf("%s: cannot open\n", path);
+        m_failed++;
+        return false;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        size = ftell(fp);
+    }
+    if (size < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        size = -1;
+    } else if ((size_t)size > m_capacity) {
+        unsigned char *data = (unsigned char *)realloc(m_data, (size_t)size);
+
+        if (data) {
+            m_data = data;
+            m_capacity = (size_t)size;
+        } else {
+            size = -1;
+        }
+    }
+    if (size < 0 || fread(m_data, 1, (size_t)size, fp) != (size_t)size) {
+        printf("%s: cannot read\n", path);
+    } else if (!replay_parse(m_data, (size_t)size, &info)) {
+        printf("%s: not a replay log\n", path);
+    } else {
+        start = clock();
+        ret = replay(path, info, verbose);
+        m_replay_seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+        m_bytes += size;
+    }
+    fclose(fp);
+    if (!ret) {
+        m_failed++;
+    }
+    return ret;
+}
+
+void Replay2048::print_summary() {
+    long spawns = m_spawns[1] + m_spawns[2];
+
+    printf("%ld logs, %ld verified (%ld unfinished), %ld failed\n", m_logs, m_verified, m_unfinished, m_failed);
+    if (m_verified <= 0) {
+        return;
+    }
+    printf("%.0f moves in %.0f bytes, replayed in %.3fs (%.0f moves/s)\n", m_moves, m_bytes, m_replay_seconds,
+         m_replay_seconds > 0.0 ? m_moves / m_replay_seconds : 0.0);
+    printf("Score: avg %.1f, min %lu, max %lu\n", m_score_sum / m_verified, m_score_min, m_score_max);
+    printf("Max tile:");
+    for (int i = 1; i < 16; ++i) {
+        if (m_max_tiles[i] > 0) {
+            printf(" %u:%ld", 1U << i, m_max_tiles[i]);
+        }
+    }
+    printf("\n");
+    if (spawns <= 0) {
+        return;
+    }
+    printf("Spawned tiles: %ld 2-tiles, %ld 4-tiles (%.2f%% 4-tiles)\n", m_spawns[1], m_spawns[2],
+         m_spawns[2] * 100.0 / spawns);
+    printf("Spawn cells (%%):\n");
+    for (int i = 0; i < 16; ++i) {
+        printf("%6.2f%s", m_spawn_cells[i] * 100.0 / spawns, (i & 3) == 3 ? "\n" : " ");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Replay2048 obj_replay;
+    bool verbose = false;
+    long failed = 0;
+    int i = 1;
+
+    if (i < argc && strcmp(argv[i], "-v") == 0) {
+        verbose = true;
+        i++;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "usage: %s [-v] log...\n", argv[0]);
+        return 2;
+    }
+    for (; i < argc; ++i) {
+        if (!obj_replay.verify_file(argv[i], verbose)) {
+            failed++;
+        }
+    }
+    obj_replay.print_summary();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,353 @@
+#ifndef MULTI_THREAD
+#define MULTI_THREAD 1
+#endif
+#define AI_NO_MAIN 1
+#undef NTUPLE
+#define NTUPLE 1
+#include "2048-ai.cpp"
+
+#if MULTI_THREAD != 1
+#error "2048-td needs MULTI_THREAD=1."
+#endif
+
+#define TD_STATE_MAGIC "2048-td"
+#define TD_STATE_VERSION 1
+
+/* two rows and two 2x3 rectangles, 128MiB of weights */
+static const signed char td_default_shapes[][NTUPLE_MAX_CELLS + 1] = {
+    { 0, 1, 2, 3, -1 },
+    { 4, 5, 6, 7, -1 },
+    { 0, 1, 2, 4, 5, 6, -1 },
+    { 4, 5, 6, 8, 9, 10, -1 },
+};
+
+/*
+ * Trains n-tuple weights by TD(0) on afterstates: every thread pool task
+ * plays whole games greedily on the current weights and moves the value of
+ * each afterstate towards the reward plus the value of the next afterstate.
+ * All tasks update the one network without locks. The weights and a small
+ * state file are saved after every batch of games, a run continues from them.
+ */
+class Train2048 {
+public:
+    Train2048(double alpha, unsigned long seed);
+    ~Train2048();
+
+    /* 1 when resumed, 0 for new weights, -1 on errors */
+    int load(const char *path);
+    bool save(const char *path);
+    void run(long episodes, long batch, int threads, const char *path);
+
+private:
+    typedef struct {
+        Train2048 *pthis;
+        board_t rng;
+        long episodes;
+        double moves;
+        double score;
+        score_t max_score;
+        long reached_2048;
+    } task_context;
+
+    static void task_worker(void *param);
+    score_t play_episode(board_t &rng, double &moves, int &max_rank);
+    board_t insert_tile(board_t board, board_t &rng);
+
+    Game2048 m_game;
+    ntuple_net_t m_net;
+    float m_alpha;
+    unsigned long m_seed;
+    long m_episodes;
+    double m_moves;
+};
+
+/* xorshift64*, 32 random bits */
+static unsigned int td_random(board_t &state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (unsigned int)((state * W64LIT(0x2545F4914F6CDD1D)) >> 32);
+}
+
+Train2048::Train2048(double alpha, unsigned long seed):m_alpha((float)alpha), m_seed(seed), m_episodes(0), m_moves(0.0) {
+    memset(&m_net, 0x00, sizeof(m_net));
+    m_game.init_tables();
+}
+
+Train2048::~Train2048() {
+    ntuple_free(&m_net);
+}
+
+/* same as Game2048::insert_tile_rand() with draw_tile(), on a per-task generator */
+board_t Train2048::insert_tile(board_t board, board_t &rng) {
+    board_t tile = td_random(rng) % 10 < 9 ? 1 : 2;
+    int index = 0;
+    board_t tmp = board;
+
+    if (board == 0) {
+        return tile << ((td_random(rng) & 15) << 2);
+    }
+    index = (int)(td_random(rng) % (unsigned int)m_game.count_empty(board));
+    while (1) {
+        while ((tmp & 0xf) != 0) {
+            tmp >>= 4;
+            tile <<= 4;
+        }
+        if (index == 0)
+            break;
+        --index;
+        tmp >>= 4;
+        tile <<= 4;
+    }
+    return board | tile;
+}
+
+score_t Train2048::play_episode(board_t &rng, double &moves, int &max_rank) {
+    /* the learning rate is shared by all weights read for one board */
+    const float rate = m_alpha / (float)(m_net.ntuples * 8);
+    board_t board = insert_tile(insert_tile(0, rng), rng);
+    board_t prev = 0;
+    score_t score = 0;
+
+    while (1) {
+        board_t best_after = 0;
+        score_t best_reward = 0;
+        float best_value = 0.0f;
+        int best = -1;
+
+        for (int move = 0; move < 4; ++move) {
+            board_t after = m_game.execute_move(board, move);
+            score_t reward = 0;
+            float value = 0.0f;
+
+            if (after == board) {
+                continue;
+            }
+            reward = m_game.score_board(after) - m_game.score_board(board);
+            value = (float)reward + ntuple_value(&m_net, after);
+            if (best < 0 || value > best_value) {
+                best = move;
+                best_value = value;
+                best_after = after;
+                best_reward = reward;
+            }
+        }
+        /* the previous afterstate learns from this one, a lost game is worth 0 */
+        if (prev) {
+            ntuple_update(&m_net, prev, rate * (best_value - ntuple_value(&m_net, prev)));
+        }
+        if (best < 0) {
+            break;
+        }
+        prev = best_after;
+        score += best_reward;
+        moves += 1.0;
+        board = insert_tile(best_after, rng);
+    }
+    max_rank = 0;
+    for (; board; board >>= 4) {
+        max_rank = _max(max_rank, (int)(board & 0xf));
+    }
+    return score;
+}
+
+void Train2048::task_worker(void *param) {
+    task_context *pcontext = (task_context *)param;
+
+    for (long i = 0; i < pcontext->episodes; ++i) {
+        int max_rank = 0;
+        score_t score = pcontext->pthis->play_episode(pcontext->rng, pcontext->moves, max_rank);
+
+        pcontext->score += score;
+        pcontext->max_score = _max(pcontext->max_score, score);
+        if (max_rank >= 11) {
+            pcontext->reached_2048++;
+        }
+    }
+}
+
+bool Train2048::save(const char *path) {
+    char tmp[FILENAME_MAX];
+    FILE *fp = NULL;
+    bool ret = false;
+
+    if (strlen(path) + 7 > sizeof(tmp)) {
+        return false;
+    }
+    /* weights first, the state file only names episodes that are saved */
+    sprintf(tmp, "%s.tmp", path);
+    if (!ntuple_save(&m_net, tmp)) {
+        return false;
+    }
+    remove(path);
+    if (rename(tmp, path) != 0) {
+        return false;
+    }
+    sprintf(tmp, "%s.td", path);
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        return false;
+    }
+    ret = fprintf(fp, "%s %d\nepisodes %ld\nmoves %.0f\n", TD_STATE_MAGIC, TD_STATE_VERSION, m_episodes, m_moves) > 0;
+    if (fclose(fp) != 0) {
+        ret = false;
+    }
+    return ret;
+}
+
+int Train2048::load(const char *path) {
+    char tmp[FILENAME_MAX];
+    char magic[16];
+    ntuple_net_t file;
+    FILE *fp = NULL;
+    int version = 0;
+    int ret = -1;
+
+    if (strlen(path) + 7 > sizeof(tmp)) {
+        return -1;
+    }
+    fp = fopen(path, "rb");
+    if (!fp) {
+        const int ntuples = (int)(sizeof(td_default_shapes) / sizeof(td_default_shapes[0]));
+
+        return ntuple_create(&m_net, ntuples, td_default_shapes) ? 0 : -1;
+    }
+    fclose(fp);
+    if (!ntuple_load(&file, path)) {
+        return -1;
+    }
+    /* train a private copy, the mapped file is replaced by every save */
+    if (ntuple_copy(&m_net, &file)) {
+        ret = 1;
+    }
+    ntuple_free(&file);
+    sprintf(tmp, "%s.td", path);
+    fp = fopen(tmp, "r");
+    if (ret > 0 && fp) {
+        if (fscanf(fp, "%15s %d episodes %ld moves %lf", magic, &version, &m_episodes, &m_moves) != 4 ||
+            strcmp(magic, TD_STATE_MAGIC) != 0 || version != TD_STATE_VERSION) {
+            ret = -1;
+        }
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    return ret;
+}
+
+void Train2048::run(long episodes, long batch, int threads, const char *path) {
+    ThreadPool thrd_pool(threads);
+    task_context *context = NULL;
+    ThrdContext *tasks = NULL;
+    time_t begin = time(NULL);
+    double begin_moves = m_moves;
+    int ntasks = 0;
+
+    if (!thrd_pool.init()) {
+        fprintf(stderr, "Init thread pool failed.");
+        fflush(stderr);
+        abort();
+    }
+    ntasks = thrd_pool.get_thrd_count();
+    context = (task_context *)malloc(ntasks * sizeof(task_context));
+    tasks = (ThrdContext *)malloc(ntasks * sizeof(ThrdContext));
+    if (!context || !tasks) {
+        fprintf(stderr, "Not enough memory.");
+        fflush(stderr);
+        abort();
+    }
+    printf("%d tuples, %lu MiB of weights, alpha %g, %d threads\n", m_net.ntuples, (unsigned long)(m_net.size >> 20), m_alpha,
+        ntasks);
+    while (m_episodes < episodes) {
+        TaskGroup group;
+        long count = _min(batch, episodes - m_episodes), played = 0;
+        double moves = 0.0, score = 0.0;
+        score_t max_score = 0;
+        long reached_2048 = 0;
+        time_t start = time(NULL);
+        double seconds = 0.0;
+
+        for (int i = 0; i < ntasks; ++i) {
+            context[i].pthis = this;
+            /* the episode number keeps the games of a resumed run new */
+            context[i].rng = ((board_t)m_seed << 32) ^ (board_t)(m_episodes + i);
+            context[i].rng = context[i].rng * W64LIT(0x9E3779B97F4A7C15) + 1;
+            context[i].episodes = count / ntasks + (i < count % ntasks ? 1 : 0);
+            context[i].moves = 0.0;
+            context[i].score = 0.0;
+            context[i].max_score = 0;
+            context[i].reached_2048 = 0;
+            tasks[i].func = task_worker;
+            tasks[i].param = &context[i];
+        }
+        thrd_pool.add_tasks(tasks, ntasks, &group);
+        group.wait();
+        for (int i = 0; i < ntasks; ++i) {
+            played += context[i].episodes;
+            moves += context[i].moves;
+            score += context[i].score;
+            max_score = _max(max_score, context[i].max_score);
+            reached_2048 += context[i].reached_2048;
+        }
+        m_episodes += played;
+        m_moves += moves;
+        seconds = difftime(time(NULL), start);
+        printf("Episodes %ld: mean score %.0f, max %lu, 2048 reached %.1f%%, %.0f moves", m_episodes, score / played,
+            (unsigned long)max_score, reached_2048 * 100.0 / played, moves);
+        if (seconds > 0.0) {
+            printf(", %.0f moves/s", moves / seconds);
+        }
+        printf("\n");
+        if (path && !save(path)) {
+            fprintf(stderr, "Cannot write weights %s.\n", path);
+        }
+        fflush(stdout);
+    }
+    if (difftime(time(NULL), begin) > 0.0) {
+        printf("Trained %.0f moves at %.0f moves/s\n", m_moves - begin_moves, (m_moves - begin_moves) / difftime(time(NULL), begin));
+    }
+    free(tasks);
+    free(context);
+}
+
+int main(int argc, char *argv[]) {
+    long episodes = 100000, batch = 1000;
+    double alpha = 0.1;
+    int threads = 0, i = 1, loaded = 0;
+    unsigned long seed = (unsigned long)time(NULL);
+    const char *path = NTUPLE_FILE;
+
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-e") == 0) {
+            episodes = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            alpha = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            threads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            seed = strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            path = argv[i + 1];
+        } else {
+            break;
+        }
+    }
+    if (i < argc || batch <= 0 || alpha <= 0.0) {
+        fprintf(stderr, "usage: %s [-e episodes] [-b batch] [-a alpha] [-t threads] [-s seed] [-o weights]\n", argv[0]);
+        return 2;
+    }
+
+    Train2048 obj_train(alpha, seed);
+
+    loaded = obj_train.load(path);
+    if (loaded < 0) {
+        fprintf(stderr, "Cannot load %s.\n", path);
+        return 1;
+    } else if (loaded > 0) {
+        printf("Resumed from %s\n", path);
+    }
+    obj_train.run(episodes, batch, threads, path);
+    return 0;
+}
@@ -0,0 +1,624 @@
+#ifndef MULTI_THREAD
+#define MULTI_THREAD 1
+#endif
+#define AI_NO_MAIN 1
+#include "2048-ai.cpp"
+
+#if MULTI_THREAD != 1 || LAZY_SMP || OPENMP_TASK || NODE_BUDGET || NTUPLE
+#error "2048-tune needs MULTI_THREAD=1 and does not support LAZY_SMP, OPENMP_TASK, NODE_BUDGET or NTUPLE."
+#endif
+
+/* tuned weights, searched as log factors of the defaults, lost_penalty stays fixed */
+#define TUNE_DIM 6
+#define TUNE_MAX_LAMBDA 32
+/* log factor limit of every weight */
+#define TUNE_RANGE 3.0
+/*
+ * the powers are capped far below the float limit (15^32 is about FLT_MAX),
+ * so the table rebuild never turns pow() into inf and its differences into NaN
+ */
+#define TUNE_POWER_MAX 16.0
+#define TUNE_CHECKPOINT_MAGIC "2048-tune"
+#define TUNE_CHECKPOINT_VERSION 1
+
+static const size_t tune_offsets[TUNE_DIM] = {
+    offsetof(heur_weights_t, monotonicity_power),
+    offsetof(heur_weights_t, monotonicity_weight),
+    offsetof(heur_weights_t, sum_power),
+    offsetof(heur_weights_t, sum_weight),
+    offsetof(heur_weights_t, merges_weight),
+    offsetof(heur_weights_t, empty_weight),
+};
+
+/* upper limit of each weight, 0 for none beyond TUNE_RANGE */
+static const double tune_max[TUNE_DIM] = { TUNE_POWER_MAX, 0.0, TUNE_POWER_MAX, 0.0, 0.0, 0.0 };
+
+/*
+ * Tunes the heuristic weights with CMA-ES. Every generation samples m_lambda
+ * candidates, each is scored by the mean score of m_games headless games at a
+ * fixed depth. All candidates of a generation play the same seeds, one thread
+ * pool task per game. The state is written to a checkpoint after every
+ * generation and a run continues from it when the file exists.
+ */
+class Tune2048 {
+public:
+    Tune2048(int depth, int games, unsigned long seed);
+    ~Tune2048();
+
+    /* 1 when resumed, 0 without checkpoint, -1 for a bad one */
+    int load(const char *path);
+    bool save(const char *path);
+    void run(int generations, int threads, const char *path);
+
+private:
+    typedef struct {
+        Tune2048 *pthis;
+        int candidate;
+        int game;
+        score_t score;
+    } game_context;
+
+    static void game_worker(void *param);
+    score_t play_game(Game2048 &game, board_t rng);
+    score_heur_t score_move(Game2048 &game, Game2048::eval_state &state, board_t board, int move);
+    board_t insert_tile(Game2048 &game, board_t board, board_t &rng, score_t &penalty);
+    void init_params();
+    void decompose();
+    void sample();
+    void evaluate(ThreadPool &thrd_pool);
+    void update();
+    double gaussian();
+    void to_weights(const double *x, heur_weights_t &weights);
+
+    int m_depth;
+    int m_games;
+    unsigned long m_seed;
+    int m_generation;
+    board_t m_rng;
+
+    /* strategy parameters, derived from TUNE_DIM */
+    int m_lambda;
+    int m_mu;
+    double m_recomb[TUNE_MAX_LAMBDA];
+    double m_mueff;
+    double m_cc;
+    double m_cs;
+    double m_c1;
+    double m_cmu;
+    double m_damps;
+    double m_chin;
+
+    /* distribution, saved in the checkpoint */
+    double m_sigma;
+    double m_mean[TUNE_DIM];
+    double m_pc[TUNE_DIM];
+    double m_ps[TUNE_DIM];
+    double m_cov[TUNE_DIM][TUNE_DIM];
+    double m_best_fitness;
+    double m_best[TUNE_DIM];
+
+    /* cov = B * diag(D^2) * B^T */
+    double m_b[TUNE_DIM][TUNE_DIM];
+    double m_d[TUNE_DIM];
+
+    double m_x[TUNE_MAX_LAMBDA][TUNE_DIM];
+    double m_fitness[TUNE_MAX_LAMBDA];
+    Game2048 *m_candidates[TUNE_MAX_LAMBDA];
+    game_context *m_context;
+    ThrdContext *m_tasks;
+};
+
+/* xorshift64*, 32 random bits */
+static unsigned int tune_random(board_t &state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (unsigned int)((state * W64LIT(0x2545F4914F6CDD1D)) >> 32);
+}
+
+Tune2048::Tune2048(int depth, int games, unsigned long seed):m_depth(depth), m_games(games), m_seed(seed), m_generation(0),
+    m_sigma(0.3), m_best_fitness(-1.0), m_context(NULL), m_tasks(NULL) {
+    m_rng = ((board_t)seed << 1) | 1;
+    init_params();
+    for (int i = 0; i < TUNE_DIM; ++i) {
+        m_mean[i] = 0.0;
+        m_pc[i] = 0.0;
+        m_ps[i] = 0.0;
+        m_best[i] = 0.0;
+        for (int j = 0; j < TUNE_DIM; ++j) {
+            m_cov[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for (int i = 0; i < m_lambda; ++i) {
+        m_candidates[i] = new Game2048;
+        m_candidates[i]->init_tables();
+    }
+    m_context = (game_context *)malloc(m_lambda * m_games * sizeof(game_context));
+    m_tasks = (ThrdContext *)malloc(m_lambda * m_games * sizeof(ThrdContext));
+    if (!m_context || !m_tasks) {
+        fprintf(stderr, "Not enough memory.");
+        fflush(stderr);
+        abort();
+    }
+}
+
+Tune2048::~Tune2048() {
+    for (int i = 0; i < m_lambda; ++i) {
+        delete m_candidates[i];
+    }
+    free(m_context);
+    free(m_tasks);
+}
+
+/* default CMA-ES settings for TUNE_DIM parameters */
+void Tune2048::init_params() {
+    const double n = TUNE_DIM;
+    double sum = 0.0, sum2 = 0.0;
+
+    m_lambda = _min(4 + (int)(3.0 * log(n)), TUNE_MAX_LAMBDA);
+    m_mu = m_lambda / 2;
+    for (int i = 0; i < m_mu; ++i) {
+        m_recomb[i] = log(m_mu + 0.5) - log(i + 1.0);
+        sum += m_recomb[i];
+    }
+    for (int i = 0; i < m_mu; ++i) {
+        m_recomb[i] /= sum;
+        sum2 += m_recomb[i] * m_recomb[i];
+    }
+    m_mueff = 1.0 / sum2;
+    m_cc = (4.0 + m_mueff / n) / (n + 4.0 + 2.0 * m_mueff / n);
+    m_cs = (m_mueff + 2.0) / (n + m_mueff + 5.0);
+    m_c1 = 2.0 / ((n + 1.3) * (n + 1.3) + m_mueff);
+    m_cmu = _min(1.0 - m_c1, 2.0 * (m_mueff - 2.0 + 1.0 / m_mueff) / ((n + 2.0) * (n + 2.0) + m_mueff));
+    m_damps = 1.0 + 2.0 * _max(0.0, sqrt((m_mueff - 1.0) / (n + 1.0)) - 1.0) + m_cs;
+    m_chin = sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+}
+
+void Tune2048::to_weights(const double *x, heur_weights_t &weights) {
+    weights = DEFAULT_HEUR_WEIGHTS;
+    for (int i = 0; i < TUNE_DIM; ++i) {
+        score_heur_t *field = (score_heur_t *)((char *)&weights + tune_offsets[i]);
+        double upper = tune_max[i] > 0.0 ? _min(TUNE_RANGE, log(tune_max[i] / *field)) : TUNE_RANGE;
+
+        *field = (score_heur_t)(*field * exp(_max(-TUNE_RANGE, _min(upper, x[i]))));
+    }
+}
+
+/* Box-Muller */
+double Tune2048::gaussian() {
+    double u1 = (tune_random(m_rng) + 1.0) / 4294967296.0;
+    double u2 = tune_random(m_rng) / 4294967296.0;
+
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+/* eigen decomposition of the covariance matrix by cyclic Jacobi rotations */
+void Tune2048::decompose() {
+    double a[TUNE_DIM][TUNE_DIM];
+    int i = 0, j = 0, k = 0;
+
+    for (i = 0; i < TUNE_DIM; ++i) {
+        for (j = 0; j < TUNE_DIM; ++j) {
+            a[i][j] = m_cov[i][j];
+            m_b[i][j] = i == j ? 1.0 : 0.0;
+        }
+    }
+    for (int sweep = 0; sweep < 50; ++sweep) {
+        double off = 0.0;
+
+        for (i = 0; i < TUNE_DIM; ++i) {
+            for (j = i + 1; j < TUNE_DIM; ++j) {
+                off += a[i][j] * a[i][j];
+            }
+        }
+        if (off < 1e-30) {
+            break;
+        }
+        for (i = 0; i < TUNE_DIM - 1; ++i) {
+            for (j = i + 1; j < TUNE_DIM; ++j) {
+                double theta, t, c, s;
+
+                if (a[i][j] == 0.0) {
+                    continue;
+                }
+                theta = (a[j][j] - a[i][i]) / (2.0 * a[i][j]);
+                t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                c = 1.0 / sqrt(t * t + 1.0);
+                s = t * c;
+                for (k = 0; k < TUNE_DIM; ++k) {
+                    double aki = a[k][i], akj = a[k][j];
+
+                    a[k][i] = c * aki - s * akj;
+                    a[k][j] = s * aki + c * akj;
+                }
+                for (k = 0; k < TUNE_DIM; ++k) {
+                    double aik = a[i][k], ajk = a[j][k];
+
+                    a[i][k] = c * aik - s * ajk;
+                    a[j][k] = s * aik + c * ajk;
+                }
+                for (k = 0; k < TUNE_DIM; ++k) {
+                    double bki = m_b[k][i], bkj = m_b[k][j];
+
+                    m_b[k][i] = c * bki - s * bkj;
+                    m_b[k][j] = s * bki + c * bkj;
+                }
+            }
+        }
+    }
+    for (i = 0; i < TUNE_DIM; ++i) {
+        m_d[i] = sqrt(_max(a[i][i], 1e-20));
+    }
+}
+
+void Tune2048::sample() {
+    decompose();
+    for (int i = 0; i < m_lambda; ++i) {
+        double z[TUNE_DIM];
+        heur_weights_t weights;
+
+        for (int j = 0; j < TUNE_DIM; ++j) {
+            z[j] = m_d[j] * gaussian();
+        }
+        for (int j = 0; j < TUNE_DIM; ++j) {
+            double y = 0.0;
+
+            for (int k = 0; k < TUNE_DIM; ++k) {
+                y += m_b[j][k] * z[k];
+            }
+            m_x[i][j] = m_mean[j] + m_sigma * y;
+        }
+        to_weights(m_x[i], weights);
+        m_candidates[i]->set_weights(weights);
+    }
+}
+
+board_t Tune2048::insert_tile(Game2048 &game, board_t board, board_t &rng, score_t &penalty) {
+    unsigned int mask = game.empty_mask(board);
+    unsigned int empty = 0;
+    board_t tile = 0;
+    int index = 0, cell = 0;
+
+    /* count_empty() wraps to 0 on the empty board */
+    for (cell = 0; cell < 16; ++cell) {
+        empty += (mask >> cell) & 1;
+    }
+    index = (int)(tune_random(rng) % empty);
+    tile = tune_random(rng) % 10 == 0 ? 2 : 1;
+    for (cell = 0;; ++cell) {
+        if ((mask >> cell) & 1) {
+            if (index-- == 0) {
+                break;
+            }
+        }
+    }
+    if (tile == 2) {
+        penalty += 4;
+    }
+    return board | (tile << (cell << 2));
+}
+
+score_heur_t Tune2048::score_move(Game2048 &game, Game2048::eval_state &state, board_t board, int move) {
+    board_t newboard = game.execute_move(board, move);
+
+    state.depth_limit = m_depth;
+    return game.score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
+}
+
+/* one game without output, the tiles come from rng only */
+score_t Tune2048::play_game(Game2048 &game, board_t rng) {
+    board_t board = 0;
+    score_t penalty = 0;
+#if ENABLE_CACHE
+    trans_table_t trans_table;
+
+#if ENABLE_CACHE == 2
+    imap_init(&trans_table);
+#endif
+#endif
+
+    board = insert_tile(game, board, rng, penalty);
+    board = insert_tile(game, board, rng, penalty);
+    while (1) {
+        int first[4];
+        int best = -1;
+        score_heur_t res[4];
+
+        if (game.root_moves(board, first) == 0) {
+            break;
+        }
+        for (int move = 0; move < 4; ++move) {
+            Game2048::eval_state state;
+
+            if (first[move] != move) {
+                continue;
+            }
+#if ENABLE_CACHE == 1
+            trans_table.clear();
+            state.trans_table = &trans_table;
+#elif ENABLE_CACHE == 2
+            imap_clear(&trans_table);
+            state.trans_table = &trans_table;
+#endif
+            res[move] = score_move(game, state, board, move);
+            if (best < 0 || res[move] > res[best]) {
+                best = move;
+            }
+        }
+        board = insert_tile(game, game.execute_move(board, best), rng, penalty);
+    }
+#if ENABLE_CACHE == 2
+    imap_delete(&trans_table);
+#endif
+    return game.score_board(board) - penalty;
+}
+
+void Tune2048::game_worker(void *param) {
+    game_context *pcontext = (game_context *)param;
+    Tune2048 *pthis = pcontext->pthis;
+    /* the same seeds for every candidate of a generation */
+    board_t rng = ((board_t)pthis->m_seed << 32) ^ ((board_t)pthis->m_generation << 16) ^ (board_t)pcontext->game;
+
+    rng = rng * W64LIT(0x9E3779B97F4A7C15) + 1;
+    pcontext->score = pthis->play_game(*pthis->m_candidates[pcontext->candidate], rng);
+}
+
+void Tune2048::evaluate(ThreadPool &thrd_pool) {
+    TaskGroup group;
+    int ntasks = m_lambda * m_games;
+
+    for (int i = 0; i < ntasks; ++i) {
+        m_context[i].pthis = this;
+        m_context[i].candidate = i / m_games;
+        m_context[i].game = i % m_games;
+        m_tasks[i].func = game_worker;
+        m_tasks[i].param = &m_context[i];
+    }
+    thrd_pool.add_tasks(m_tasks, ntasks, &group);
+    group.wait();
+    for (int i = 0; i < m_lambda; ++i) {
+        double sum = 0.0;
+
+        for (int j = 0; j < m_games; ++j) {
+            sum += m_context[i * m_games + j].score;
+        }
+        m_fitness[i] = sum / m_games;
+    }
+}
+
+void Tune2048::update() {
+    int order[TUNE_MAX_LAMBDA];
+    double old_mean[TUNE_DIM], y[TUNE_MAX_LAMBDA][TUNE_DIM], yw[TUNE_DIM], z[TUNE_DIM];
+    double norm = 0.0, hsig = 0.0;
+    int i = 0, j = 0, k = 0;
+
+    /* best first */
+    for (i = 0; i < m_lambda; ++i) {
+        for (j = i; j > 0 && m_fitness[order[j - 1]] < m_fitness[i]; --j) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    if (m_fitness[order[0]] > m_best_fitness) {
+        m_best_fitness = m_fitness[order[0]];
+        memcpy(m_best, m_x[order[0]], sizeof(m_best));
+    }
+
+    for (j = 0; j < TUNE_DIM; ++j) {
+        old_mean[j] = m_mean[j];
+        m_mean[j] = 0.0;
+        for (i = 0; i < m_mu; ++i) {
+            m_mean[j] += m_recomb[i] * m_x[order[i]][j];
+        }
+        yw[j] = (m_mean[j] - old_mean[j]) / m_sigma;
+        for (i = 0; i < m_mu; ++i) {
+            y[i][j] = (m_x[order[i]][j] - old_mean[j]) / m_sigma;
+        }
+    }
+
+    /* ps follows C^-1/2 * yw = B * D^-1 * B^T * yw */
+    for (k = 0; k < TUNE_DIM; ++k) {
+        z[k] = 0.0;
+        for (j = 0; j < TUNE_DIM; ++j) {
+            z[k] += m_b[j][k] * yw[j];
+        }
+        z[k] /= m_d[k];
+    }
+    for (j = 0; j < TUNE_DIM; ++j) {
+        double cyw = 0.0;
+
+        for (k = 0; k < TUNE_DIM; ++k) {
+            cyw += m_b[j][k] * z[k];
+        }
+        m_ps[j] = (1.0 - m_cs) * m_ps[j] + sqrt(m_cs * (2.0 - m_cs) * m_mueff) * cyw;
+        norm += m_ps[j] * m_ps[j];
+    }
+    norm = sqrt(norm);
+    hsig = norm / sqrt(1.0 - pow(1.0 - m_cs, 2.0 * (m_generation + 1))) / m_chin < 1.4 + 2.0 / (TUNE_DIM + 1.0) ? 1.0 : 0.0;
+    for (j = 0; j < TUNE_DIM; ++j) {
+        m_pc[j] = (1.0 - m_cc) * m_pc[j] + hsig * sqrt(m_cc * (2.0 - m_cc) * m_mueff) * yw[j];
+    }
+
+    for (j = 0; j < TUNE_DIM; ++j) {
+        for (k = 0; k < TUNE_DIM; ++k) {
+            double rank_mu = 0.0;
+
+            for (i = 0; i < m_mu; ++i) {
+                rank_mu += m_recomb[i] * y[i][j] * y[i][k];
+            }
+            m_cov[j][k] = (1.0 - m_c1 - m_cmu) * m_cov[j][k] +
+                m_c1 * (m_pc[j] * m_pc[k] + (1.0 - hsig) * m_cc * (2.0 - m_cc) * m_cov[j][k]) + m_cmu * rank_mu;
+        }
+    }
+    m_sigma *= exp((m_cs / m_damps) * (norm / m_chin - 1.0));
+    m_generation++;
+}
+
+static bool tune_write_vector(FILE *fp, const char *name, const double *v) {
+    fprintf(fp, "%s", name);
+    for (int i = 0; i < TUNE_DIM; ++i) {
+        fprintf(fp, " %.17g", v[i]);
+    }
+    return fprintf(fp, "\n") > 0;
+}
+
+static bool tune_read_vector(FILE *fp, const char *name, double *v) {
+    char buf[16];
+
+    if (fscanf(fp, "%15s", buf) != 1 || strcmp(buf, name) != 0) {
+        return false;
+    }
+    for (int i = 0; i < TUNE_DIM; ++i) {
+        if (fscanf(fp, "%lf", &v[i]) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Tune2048::save(const char *path) {
+    char tmp[FILENAME_MAX];
+    FILE *fp = NULL;
+    bool ret = true;
+
+    if (strlen(path) + 5 > sizeof(tmp)) {
+        return false;
+    }
+    sprintf(tmp, "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "%s %d\n", TUNE_CHECKPOINT_MAGIC, TUNE_CHECKPOINT_VERSION);
+    fprintf(fp, "dim %d lambda %d depth %d games %d seed %lu generation %d\n", TUNE_DIM, m_lambda, m_depth, m_games, m_seed,
+        m_generation);
+    fprintf(fp, "rng %lu %lu\n", (unsigned long)(m_rng >> 32), (unsigned long)(m_rng & 0xFFFFFFFF));
+    fprintf(fp, "sigma %.17g\n", m_sigma);
+    fprintf(fp, "fitness %.17g\n", m_best_fitness);
+    ret = tune_write_vector(fp, "best", m_best) && tune_write_vector(fp, "mean", m_mean) &&
+        tune_write_vector(fp, "pc", m_pc) && tune_write_vector(fp, "ps", m_ps);
+    for (int i = 0; i < TUNE_DIM && ret; ++i) {
+        ret = tune_write_vector(fp, "cov", m_cov[i]);
+    }
+    if (fclose(fp) != 0) {
+        ret = false;
+    }
+    /* rename() does not replace an existing file everywhere */
+    if (ret) {
+        remove(path);
+        ret = rename(tmp, path) == 0;
+    }
+    return ret;
+}
+
+int Tune2048::load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char magic[16];
+    int version = 0, dim = 0, lambda = 0, depth = 0, games = 0, generation = 0;
+    unsigned long seed = 0, rng_high = 0, rng_low = 0;
+    bool ret = false;
+
+    if (!fp) {
+        return 0;
+    }
+    if (fscanf(fp, "%15s %d", magic, &version) == 2 && strcmp(magic, TUNE_CHECKPOINT_MAGIC) == 0 &&
+        version == TUNE_CHECKPOINT_VERSION &&
+        fscanf(fp, " dim %d lambda %d depth %d games %d seed %lu generation %d", &dim, &lambda, &depth, &games, &seed, &generation) == 6 &&
+        dim == TUNE_DIM && lambda == m_lambda && games == m_games &&
+        fscanf(fp, " rng %lu %lu", &rng_high, &rng_low) == 2 && fscanf(fp, " sigma %lf", &m_sigma) == 1 &&
+        fscanf(fp, " fitness %lf", &m_best_fitness) == 1 && tune_read_vector(fp, "best", m_best) &&
+        tune_read_vector(fp, "mean", m_mean) && tune_read_vector(fp, "pc", m_pc) && tune_read_vector(fp, "ps", m_ps)) {
+        ret = true;
+        for (int i = 0; i < TUNE_DIM && ret; ++i) {
+            ret = tune_read_vector(fp, "cov", m_cov[i]);
+        }
+    }
+    fclose(fp);
+    if (ret) {
+        m_depth = depth;
+        m_seed = seed;
+        m_generation = generation;
+        m_rng = ((board_t)rng_high << 32) | (board_t)rng_low;
+    }
+    return ret ? 1 : -1;
+}
+
+void Tune2048::run(int generations, int threads, const char *path) {
+    ThreadPool thrd_pool(threads);
+    heur_weights_t weights;
+
+    if (!thrd_pool.init()) {
+        fprintf(stderr, "Init thread pool failed.");
+        fflush(stderr);
+        abort();
+    }
+    printf("%d candidates x %d games per generation, depth %d, %d threads\n", m_lambda, m_games, m_depth,
+        thrd_pool.get_thrd_count());
+    while (m_generation < generations) {
+        time_t start = time(NULL);
+        int best = 0;
+
+        sample();
+        evaluate(thrd_pool);
+        for (int i = 1; i < m_lambda; ++i) {
+            if (m_fitness[i] > m_fitness[best]) {
+                best = i;
+            }
+        }
+        printf("Generation %d: best %.0f, sigma %.4f, %.0fs\n", m_generation + 1, m_fitness[best], m_sigma,
+            difftime(time(NULL), start));
+        to_weights(m_x[best], weights);
+        print_heur_weights(stdout, weights);
+        update();
+        if (path && !save(path)) {
+            fprintf(stderr, "Cannot write checkpoint %s.\n", path);
+        }
+        fflush(stdout);
+    }
+    to_weights(m_mean, weights);
+    printf("Mean: ");
+    print_heur_weights(stdout, weights);
+    to_weights(m_best, weights);
+    printf("Best (%.0f): ", m_best_fitness);
+    print_heur_weights(stdout, weights);
+}
+
+int main(int argc, char *argv[]) {
+    int depth = 1, games = 16, generations = 50, threads = 0, i = 1;
+    unsigned long seed = (unsigned long)time(NULL);
+    const char *path = "2048-tune.ckp";
+
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-d") == 0) {
+            depth = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-g") == 0) {
+            games = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            generations = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            threads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            seed = strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            path = argv[i + 1];
+        } else {
+            break;
+        }
+    }
+    if (i < argc || depth <= 0 || games <= 0) {
+        fprintf(stderr, "usage: %s [-d depth] [-g games] [-n generations] [-t threads] [-s seed] [-c checkpoint]\n", argv[0]);
+        return 2;
+    }
+
+    Tune2048 obj_tune(depth, games, seed);
+    int loaded = obj_tune.load(path);
+
+    if (loaded < 0) {
+        fprintf(stderr, "%s is not a checkpoint of %d games per candidate.\n", path, games);
+        return 1;
+    } else if (loaded > 0) {
+        printf("Resumed from %s\n", path);
+    }
+    obj_tune.run(generations, threads, path);
+    return 0;
+}
@@ -1,12 +1,27 @@
 #define SUPPORT_64BIT 1
 #include "arch.h"
 
+/* 1 keeps every position in a file for undo, redo and resuming; 0 undoes the last 64 moves */
+#ifndef GAME_HISTORY
+#define GAME_HISTORY 0
+#endif
+
+#if GAME_HISTORY
+#include "history.c"
+
+/* undo/redo history and the game to resume, NULL keeps it in memory only */
+#ifndef HISTORY_FILE
+#define HISTORY_FILE "2048.hst"
+#endif
+#endif
+
 enum {
     UP = 0,
     DOWN,
     LEFT,
     RIGHT,
-    RETRACT
+    RETRACT,
+    REDO
 };
 
 class Game2048 {
@@ -37,6 +52,9 @@ private:
     void print_board(board_t board);
     board_t transpose(board_t x);
     int count_empty(board_t x);
+#if GAME_HISTORY
+    int has_moves(board_t board);
+#endif
 
 #ifdef __16BIT__
     void init_tables();
@@ -323,6 +341,10 @@ int Game2048::ask_for_move(board_t board) {
             return -1;
         } else if (movechar == 'r') {
             return RETRACT;
+#if GAME_HISTORY
+        } else if (movechar == 'f') {
+            return REDO;
+#endif
         }
         pos = strchr(allmoves, movechar);
         if (pos) {
@@ -331,6 +353,96 @@ int Game2048::ask_for_move(board_t board) {
     }
 }
 
+#if GAME_HISTORY
+int Game2048::has_moves(board_t board) {
+    for (int move = 0; move < 4; move++) {
+        if (execute_move(board, move) != board)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Every position goes to the history, so undo and redo only move its cursor
+ * and an unfinished game continues where it was left at the next start.
+ */
+void Game2048::play_game() {
+    board_t board = 0;
+    history_t history;
+    long scorepenalty = 0;
+    long last_score = 0, current_score = 0, moveno = 0;
+
+#ifdef __16BIT__
+    init_tables();
+#endif
+    board = initial_board();
+    if (!history_open(&history, HISTORY_FILE, board)) {
+        fprintf(stderr, "Cannot open history %s, undo is kept in memory.\n", HISTORY_FILE ? HISTORY_FILE : "");
+        if (!history_open(&history, NULL, board)) {
+            fprintf(stderr, "Not enough memory.");
+            fflush(stderr);
+            abort();
+        }
+    }
+    if (!has_moves(history_board(&history))) {
+        history_reset(&history, board);
+    }
+    while (1) {
+        int move = 0;
+        row_t tile = 0;
+        board_t newboard;
+
+        board = history_board(&history);
+        scorepenalty = (long)history_penalty(&history);
+        moveno = (long)history_moves(&history) + 1;
+        clear_screen();
+        if (!has_moves(board))
+            break;
+
+        current_score = score_board(board) - scorepenalty;
+        printf("Move #%ld, current score=%ld(+%ld)\n", moveno, current_score, current_score - last_score);
+        last_score = current_score;
+
+        move = ask_for_move(board);
+        if (move < 0)
+            break;
+
+        if (move == RETRACT) {
+            history_undo(&history);
+            continue;
+        } else if (move == REDO) {
+            history_redo(&history);
+            continue;
+        }
+
+        newboard = execute_move(board, move);
+        if (newboard == board) {
+            continue;
+        }
+
+        tile = draw_tile();
+        if (tile == 2) {
+            scorepenalty += 4;
+        }
+        newboard = insert_tile_rand(newboard, tile);
+        if (!history_push(&history, newboard, (unsigned long)scorepenalty)) {
+            fprintf(stderr, "Cannot write history %s, undo is kept in memory.\n", HISTORY_FILE ? HISTORY_FILE : "");
+            /* a failed write may have recorded the position in memory already */
+            if (!history_detach(&history) ||
+                (history_moves(&history) + 1 == (unsigned long)moveno &&
+                 !history_push(&history, newboard, (unsigned long)scorepenalty))) {
+                fprintf(stderr, "Not enough memory.");
+                fflush(stderr);
+                abort();
+            }
+        }
+    }
+
+    print_board(board);
+    printf("Game over. Your score is %ld.\n", current_score);
+    history_close(&history);
+}
+#else
 void Game2048::play_game() {
     board_t board = initial_board();
     int scorepenalty = 0;
@@ -403,6 +515,7 @@ void Game2048::play_game() {
     print_board(board);
     printf("Game over. Your score is %ld.\n", current_score);
 }
+#endif
 
 int main() {
     Game2048 obj_2048;
@@ -2,7 +2,26 @@
 #include "arch.h"
 #include <math.h>
 
-#if ENABLE_CACHE
+#if ENABLE_CACHE != 0 && ENABLE_CACHE != 1 && ENABLE_CACHE != 2
+#error "ENABLE_CACHE must be 0 (no cache) or 1 (fixed table) or 2 (use c map)"
+#endif
+
+#if ENABLE_CACHE == 1
+/* direct-mapped, 2^CACHE_BITS entries in a single allocation under 64KiB */
+#ifndef CACHE_BITS
+#define CACHE_BITS 12
+#endif
+#if CACHE_BITS > 16 || (defined(__16BIT__) && CACHE_BITS > 12)
+#error "CACHE_BITS must not exceed 16, or 12 for 16-bit targets."
+#endif
+#define CACHE_ENTRIES (1 << CACHE_BITS)
+typedef struct {
+    board_t board;
+    score_heur_t heuristic;
+    unsigned char depth;
+    unsigned char generation;   /* 0 is never current, a new table is empty */
+} trans_table_entry_t;
+#elif ENABLE_CACHE == 2
 #include "cmap.c"
 typedef struct {
     int depth;
@@ -29,6 +48,9 @@ const score_heur_t SCORE_EMPTY_WEIGHT = 270.0f;
 const score_heur_t CPROB_THRESH_BASE = 0.0001f;
 #if ENABLE_CACHE
 const row_t CACHE_DEPTH_LIMIT = 15;
+#ifndef CACHE_DEPTH_MAX
+#define CACHE_DEPTH_MAX 4
+#endif
 #endif
 
 class Game2048 {
@@ -45,12 +67,14 @@ public:
     int find_best_move(board_t board);
 
 private:
-    board_t unpack_col(row_t row);
     row_t reverse_row(row_t row);
+    row_t move_left(row_t row);
+    row_t move_right(row_t row);
     unsigned int unif_random(unsigned int n); 
     void print_board(board_t board);
     board_t transpose(board_t x); 
     int count_empty(board_t x); 
+    int get_depth_limit(board_t board);
 
     void init_tables();
     void alloc_tables();
@@ -73,20 +97,35 @@ private:
         long nomoves;
         long tablehits;
         long cachehits;
+        long cachelookups;
         long moves_evaled;
         int depth_limit;
-#if ENABLE_CACHE
+#if ENABLE_CACHE == 2
         trans_table_t trans_table;
 #endif
 
-        eval_state() : maxdepth(0), curdepth(0), nomoves(0), tablehits(0), cachehits(0), moves_evaled(0), depth_limit(0) {}
+        eval_state() : maxdepth(0), curdepth(0), nomoves(0), tablehits(0), cachehits(0), cachelookups(0), moves_evaled(0),
+            depth_limit(0) {}
     };  
     score_heur_t score_move_node(eval_state &state, board_t board, score_heur_t cprob);
     score_heur_t score_tilechoose_node(eval_state &state, board_t board, score_heur_t cprob);
     score_heur_t score_toplevel_move(board_t board, int move);
 
 #define TABLESIZE 8192
+/* the top 3 bits of a row pick the segment, the low 13 bits the entry */
+#define TABLE_SEGMENT(row) ((row) >> 13)
+#define TABLE_INDEX(row) ((row) & (TABLESIZE - 1))
+    /* row ^ row moved left, in segments that fit 16-bit memory models */
+    row_t *row_table[8];
     score_heur_t* score_heur_table[8];
+#if ENABLE_CACHE == 1
+    row_t cache_index(board_t board);
+    void cache_clear();
+
+    trans_table_entry_t *m_cache;
+    unsigned char m_cache_generation;
+    long m_cache_used;
+#endif
 };
 
 unsigned int Game2048::unif_random(unsigned int n) {
@@ -100,16 +139,6 @@ unsigned int Game2048::unif_random(unsigned int n) {
     return rand() % n;
 }
 
-board_t Game2048::unpack_col(row_t row) {
-    board_t board;
-
-    board.r0 = (row & 0xF000) >> 12;
-    board.r1 = (row & 0x0F00) >> 8;
-    board.r2 = (row & 0x00F0) >> 4;
-    board.r3 = row & 0x000F;
-    return board;
-}
-
 row_t Game2048::reverse_row(row_t row) {
     return (row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12);
 }
@@ -134,35 +163,52 @@ void Game2048::print_board(board_t board) {
     printf("-----------------------------\n");
 }
 
+/* delta swaps: nibbles within each 2x2 block, then the 2x2 blocks */
 board_t Game2048::transpose(board_t x) {
-    row_t a1_0 = x.r0 & 0xF0F0;
-    row_t a1_1 = x.r1 & 0x0F0F;
-    row_t a1_2 = x.r2 & 0xF0F0;
-    row_t a1_3 = x.r3 & 0x0F0F;
-    row_t a2_1 = x.r1 & 0xF0F0;
-    row_t a2_3 = x.r3 & 0xF0F0;
-    row_t a3_0 = x.r0 & 0x0F0F;
-    row_t a3_2 = x.r2 & 0x0F0F;
-    row_t r0 = a1_0 | (a2_1 >> 4);
-    row_t r1 = a1_1 | (a3_0 << 4);
-    row_t r2 = a1_2 | (a2_3 >> 4);
-    row_t r3 = a1_3 | (a3_2 << 4);
-    row_t b1_0 = r0 & 0xFF00;
-    row_t b1_1 = r1 & 0xFF00;
-    row_t b1_2 = r2 & 0x00FF;
-    row_t b1_3 = r3 & 0x00FF;
-    row_t b2_0 = r0 & 0x00FF;
-    row_t b2_1 = r1 & 0x00FF;
-    row_t b3_2 = r2 & 0xFF00;
-    row_t b3_3 = r3 & 0xFF00;
-
-    x.r0 = b1_0 | (b3_2 >> 8);
-    x.r1 = b1_1 | (b3_3 >> 8);
-    x.r2 = b1_2 | (b2_0 << 8);
-    x.r3 = b1_3 | (b2_1 << 8);
+    row_t t = ((x.r1 >> 4) ^ x.r0) & 0x0F0F;
+
+    x.r0 ^= t;
+    x.r1 ^= t << 4;
+    t = ((x.r3 >> 4) ^ x.r2) & 0x0F0F;
+    x.r2 ^= t;
+    x.r3 ^= t << 4;
+    t = ((x.r2 >> 8) ^ x.r0) & 0x00FF;
+    x.r0 ^= t;
+    x.r2 ^= t << 8;
+    t = ((x.r3 >> 8) ^ x.r1) & 0x00FF;
+    x.r1 ^= t;
+    x.r3 ^= t << 8;
     return x;
 }
 
+/* deeper searches need the cache, and only pay off once there are many distinct tiles */
+int Game2048::get_depth_limit(board_t board) {
+#if ENABLE_CACHE
+    row_t bitset = 0;
+    int count = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        row_t row = ((row_t *)&board)[i];
+
+        for (int j = 0; j < 4; ++j) {
+            bitset |= 1u << (row & 0xf);
+            row >>= 4;
+        }
+    }
+    bitset >>= 1;
+    while (bitset) {
+        count += bitset & 1;
+        bitset >>= 1;
+    }
+    count -= 2;
+    count = _max(count, 3);
+    count = _min(count, CACHE_DEPTH_MAX);
+    return count;
+#else
+    return 3;
+#endif
+}
+
 int Game2048::count_empty(board_t board) {
     row_t sum = 0, x = 0, i = 0;
 
@@ -230,32 +276,74 @@ void Game2048::init_tables(void) {
             }
         }
 
-        score_heur_table[row / TABLESIZE][row % TABLESIZE] =
+        score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] =
             (score_heur_t)(SCORE_LOST_PENALTY +
                            SCORE_EMPTY_WEIGHT * empty +
                            SCORE_MERGES_WEIGHT * merges -
                            SCORE_MONOTONICITY_WEIGHT *
                            _min(monotonicity_left, monotonicity_right) - SCORE_SUM_WEIGHT * sum);
+        row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)] = row ^ execute_move_helper(row);
     } while (row++ != 0xFFFF);
 }
 
 void Game2048::alloc_tables(void) {
+    memset(row_table, 0x00, sizeof(row_table));
     memset(score_heur_table, 0x00, sizeof(score_heur_table));
     for (int i = 0; i < 8; ++i) {
+        row_table[i] = (row_t *)malloc(sizeof(row_t) * TABLESIZE);
         score_heur_table[i] = (score_heur_t *)malloc(sizeof(score_heur_t) * TABLESIZE);
-        if (!score_heur_table[i]) {
+        if (!row_table[i] || !score_heur_table[i]) {
             fprintf(stderr, "Not enough memory.");
             fflush(stderr);
             abort();
         }
     }
+#if ENABLE_CACHE == 1
+    m_cache = (trans_table_entry_t *)malloc(sizeof(trans_table_entry_t) * CACHE_ENTRIES);
+    if (!m_cache) {
+        fprintf(stderr, "Not enough memory.");
+        fflush(stderr);
+        abort();
+    }
+    m_cache_generation = 0;
+    cache_clear();
+#endif
 }
 
 void Game2048::free_tables(void) {
     for (int i = 0; i < 8; ++i) {
+        free(row_table[i]);
         free(score_heur_table[i]);
     }
+#if ENABLE_CACHE == 1
+    free(m_cache);
+#endif
+}
+
+#if ENABLE_CACHE == 1
+/*
+ * multiplicative hash of the four rows in 16-bit arithmetic, the high bits
+ * of each product are folded down since a multiply only carries upwards
+ */
+row_t Game2048::cache_index(board_t board) {
+    row_t hash = (row_t)(board.r0 * 40503u);
+
+    hash = (row_t)(((hash ^ (hash >> 8)) ^ board.r1) * 40503u);
+    hash = (row_t)(((hash ^ (hash >> 8)) ^ board.r2) * 40503u);
+    hash = (row_t)(((hash ^ (hash >> 8)) ^ board.r3) * 40503u);
+    hash = (row_t)((hash ^ (hash >> 8)) * 40503u);
+    return hash >> (16 - CACHE_BITS);
+}
+
+/* entries of older generations are stale, the table is only wiped when the counter wraps */
+void Game2048::cache_clear() {
+    if (++m_cache_generation == 0) {
+        memset(m_cache, 0x00, sizeof(trans_table_entry_t) * CACHE_ENTRIES);
+        m_cache_generation = 1;
+    }
+    m_cache_used = 0;
 }
+#endif
 
 row_t Game2048::execute_move_helper(row_t row) {
     int i = 0, j = 0;
@@ -305,34 +393,36 @@ score_t Game2048::score_helper(board_t board) {
     return score;
 }
 
-board_t Game2048::execute_move(board_t board, int move) {
-    board_t ret = board, tran, tmp;
-    row_t *t = (row_t *)&ret;
-    row_t row;
+/* the changed bits of row moved left */
+row_t Game2048::move_left(row_t row) {
+    return row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
+}
+
+row_t Game2048::move_right(row_t row) {
+    row = reverse_row(row);
+    return reverse_row(row_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)]);
+}
 
+/* columns are moved as the rows of the transposed board */
+board_t Game2048::execute_move(board_t board, int move) {
     if (move == UP || move == DOWN) {
-        tran = transpose(board);
-        t = (row_t *)&tran;
+        board = transpose(board);
     }
-    for (int i = 0; i < 4; ++i) {
-        row = t[3 - i];
-        if (move == UP) {
-            tmp = unpack_col(row ^ execute_move_helper(row));
-        } else if (move == DOWN) {
-            tmp = unpack_col(row ^ reverse_row(execute_move_helper(reverse_row(row))));
-        } else if (move == LEFT) {
-            t[3 - i] ^= row ^ execute_move_helper(row);
-        } else if (move == RIGHT) {
-            t[3 - i] ^= row ^ reverse_row(execute_move_helper(reverse_row(row)));
-        }
-        if (move == UP || move == DOWN) {
-            ret.r0 ^= tmp.r0 << (i << 2);
-            ret.r1 ^= tmp.r1 << (i << 2);
-            ret.r2 ^= tmp.r2 << (i << 2);
-            ret.r3 ^= tmp.r3 << (i << 2);
-        }
+    if (move == UP || move == LEFT) {
+        board.r0 ^= move_left(board.r0);
+        board.r1 ^= move_left(board.r1);
+        board.r2 ^= move_left(board.r2);
+        board.r3 ^= move_left(board.r3);
+    } else {
+        board.r0 ^= move_right(board.r0);
+        board.r1 ^= move_right(board.r1);
+        board.r2 ^= move_right(board.r2);
+        board.r3 ^= move_right(board.r3);
     }
-    return ret;
+    if (move == UP || move == DOWN) {
+        board = transpose(board);
+    }
+    return board;
 }
 
 score_heur_t Game2048::score_heur_helper(board_t board) {
@@ -341,7 +431,7 @@ score_heur_t Game2048::score_heur_helper(board_t board) {
 
     for (int i = 0; i < 4; ++i) {
         row = ((row_t *)&board)[3 - i];
-        score_heur += score_heur_table[row / TABLESIZE][row % TABLESIZE];
+        score_heur += score_heur_table[TABLE_SEGMENT(row)][TABLE_INDEX(row)];
     }
     return score_heur;
 }
@@ -418,9 +508,22 @@ score_heur_t Game2048::score_tilechoose_node(eval_state &state, board_t board, s
         return score_heur_board(board);
     }
 
-#if ENABLE_CACHE
+#if ENABLE_CACHE == 1
+    if (state.curdepth < CACHE_DEPTH_LIMIT) {
+        trans_table_entry_t *entry = &m_cache[cache_index(board)];
+
+        state.cachelookups++;
+        if (entry->generation == m_cache_generation && memcmp(&entry->board, &board, sizeof(board_t)) == 0 &&
+            entry->depth <= state.curdepth) {
+            state.cachehits++;
+            return entry->heuristic;
+        }
+    }
+#elif ENABLE_CACHE == 2
     if (state.curdepth < CACHE_DEPTH_LIMIT) {
         trans_table_entry_t *entry = (trans_table_entry_t *)map_get(&state.trans_table, board);
+
+        state.cachelookups++;
         if (entry != NULL) {
             if (entry->depth <= state.curdepth) {
                 state.cachehits++;
@@ -447,7 +550,20 @@ score_heur_t Game2048::score_tilechoose_node(eval_state &state, board_t board, s
     }
     res = res / num_open;
 
-#if ENABLE_CACHE
+#if ENABLE_CACHE == 1
+    if (state.curdepth < CACHE_DEPTH_LIMIT) {
+        trans_table_entry_t *entry = &m_cache[cache_index(board)];
+
+        /* always replace: the newest board is the likeliest to come again */
+        if (entry->generation != m_cache_generation) {
+            m_cache_used++;
+        }
+        entry->board = board;
+        entry->heuristic = res;
+        entry->depth = (unsigned char)state.curdepth;
+        entry->generation = m_cache_generation;
+    }
+#elif ENABLE_CACHE == 2
     if (state.curdepth < CACHE_DEPTH_LIMIT) {
         trans_table_entry_t entry;
         entry.depth = state.curdepth;
@@ -487,23 +603,33 @@ score_heur_t Game2048::score_toplevel_move(board_t board, int move) {
     score_heur_t res = 0.0f;
     board_t newboard = execute_move(board, move);
 
-#if ENABLE_CACHE
+#if ENABLE_CACHE == 1
+    cache_clear();
+#elif ENABLE_CACHE == 2
     map_init(&state.trans_table, NULL, NULL);
 #endif
-    state.depth_limit = 3;
+    state.depth_limit = get_depth_limit(board);
     if (memcmp(&newboard, &board, sizeof(board_t)) != 0)
         res = score_tilechoose_node(state, newboard, 1.0f) + 1e-6f;
 
     printf("Move %d: result %f: eval'd %ld moves (%ld no moves, %ld table hits, %ld cache hits, %ld cache size) (maxdepth=%d)\n",
          move, res, state.moves_evaled, state.nomoves, state.tablehits, state.cachehits,
-#if ENABLE_CACHE
+#if ENABLE_CACHE == 1
+         m_cache_used,
+#elif ENABLE_CACHE == 2
          (long)state.trans_table.base.nnodes,
 #else
          0L,
 #endif
          state.maxdepth);
-
 #if ENABLE_CACHE
+    if (state.cachelookups > 0) {
+        printf("Move %d: cache hit rate %.1f%% (%ld lookups), depth limit %d\n", move,
+             state.cachehits * 100.0 / state.cachelookups, state.cachelookups, state.depth_limit);
+    }
+#endif
+
+#if ENABLE_CACHE == 2
     map_delete(&state.trans_table);
 #endif
     return res;
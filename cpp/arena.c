@@ -0,0 +1 @@
+../c/arena.c
\ No newline at end of file
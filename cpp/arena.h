@@ -0,0 +1 @@
+../c/arena.h
\ No newline at end of file
@@ -0,0 +1 @@
+../c/history.c
\ No newline at end of file
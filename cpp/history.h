@@ -0,0 +1 @@
+../c/history.h
\ No newline at end of file
@@ -0,0 +1 @@
+../c/imap.c
\ No newline at end of file
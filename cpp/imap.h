@@ -0,0 +1 @@
+../c/imap.h
\ No newline at end of file
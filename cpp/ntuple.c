@@ -0,0 +1 @@
+../c/ntuple.c
\ No newline at end of file
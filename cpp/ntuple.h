@@ -0,0 +1 @@
+../c/ntuple.h
\ No newline at end of file
@@ -0,0 +1 @@
+../c/replay.c
\ No newline at end of file
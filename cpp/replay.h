@@ -0,0 +1 @@
+../c/replay.h
\ No newline at end of file
@@ -6,6 +6,7 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined(__GLIBC__) && __GLIBC__ >= 2 && __GLIBC_MINOR__ >= 2
 #include <sys/sysinfo.h>
@@ -54,7 +55,48 @@ void ThreadLock::ConditionVariableLegacy::broadcast() {
 }
 #endif
 
-ThreadLock::ThreadLock() {
+ThreadQueue::ThreadQueue():m_buf(NULL), m_mask(0), m_allocs(0), m_head(0), m_tail(0) {
+    m_buf = (ThrdContext *)malloc(THRD_QUEUE_INIT_SIZE * sizeof(ThrdContext));
+    if (m_buf) {
+        m_mask = THRD_QUEUE_INIT_SIZE - 1;
+        m_allocs++;
+    }
+}
+
+ThreadQueue::~ThreadQueue() {
+    free(m_buf);
+}
+
+bool ThreadQueue::grow() {
+    unsigned long capacity = m_buf ? (m_mask + 1) << 1 : THRD_QUEUE_INIT_SIZE;
+    unsigned long count = m_tail - m_head;
+    ThrdContext *buf = (ThrdContext *)malloc(capacity * sizeof(ThrdContext));
+
+    if (!buf) {
+        return false;
+    }
+    for (unsigned long i = 0; i < count; ++i) {
+        buf[i] = m_buf[(m_head + i) & m_mask];
+    }
+    free(m_buf);
+    m_buf = buf;
+    m_mask = capacity - 1;
+    m_head = 0;
+    m_tail = count;
+    m_allocs++;
+    return true;
+}
+
+bool ThreadQueue::push_back(const ThrdContext &context) {
+    if ((!m_buf || m_tail - m_head > m_mask) && !grow()) {
+        return false;
+    }
+    m_buf[m_tail & m_mask] = context;
+    m_tail++;
+    return true;
+}
+
+ThreadLock::ThreadLock():m_spin_count(0) {
 #ifdef _WIN32
     InitializeCriticalSection(&m_mutex);
 #if defined(WINVER) && WINVER >= 0x0600
@@ -79,6 +121,12 @@ void ThreadLock::lock() {
 #ifdef _WIN32
     EnterCriticalSection(&m_mutex);
 #else
+    for (int i = 0; i < m_spin_count; ++i) {
+        if (pthread_mutex_trylock(&m_mutex) == 0) {
+            return;
+        }
+        THRD_CPU_PAUSE();
+    }
     pthread_mutex_lock(&m_mutex);
 #endif
 }
@@ -91,6 +139,13 @@ void ThreadLock::unlock() {
 #endif
 }
 
+void ThreadLock::set_spin_count(int spin_count) {
+    m_spin_count = (spin_count > 0) ? spin_count : 0;
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0403
+    SetCriticalSectionSpinCount(&m_mutex, (DWORD)m_spin_count);
+#endif
+}
+
 bool ThreadLock::wait(int timeout_ms /* = -1 */ ) {
 #ifdef _WIN32
 #if defined(WINVER) && WINVER >= 0x0600
@@ -143,6 +198,74 @@ void ThreadLock::broadcast() {
 #endif
 }
 
+TaskGroup::TaskGroup():m_pending(0), m_spin_count(0) {
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::wait() {
+    for (int i = 0; i < m_spin_count && m_pending > 0; ++i) {
+        THRD_CPU_PAUSE();
+    }
+
+    LockScope lock(this->m_lock);
+    while (m_pending > 0) {
+        m_lock.wait();
+    }
+}
+
+int TaskGroup::pending() {
+    LockScope lock(this->m_lock);
+    return m_pending;
+}
+
+void TaskGroup::add(int count, int spin_count) {
+    LockScope lock(this->m_lock);
+    m_pending += count;
+    m_spin_count = spin_count;
+}
+
+void TaskGroup::done() {
+    LockScope lock(this->m_lock);
+    if (--m_pending <= 0) {
+        m_lock.broadcast();
+    }
+}
+
+#if THRD_POOL_PROFILE
+static double _clock_us() {
+#ifdef _WIN32
+    static double freq = 0.0;
+    LARGE_INTEGER counter;
+
+    if (freq == 0.0) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        freq = (double)f.QuadPart / 1000000.0;
+    }
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / freq;
+#else
+    timeval now = { 0, 0 };
+
+    gettimeofday(&now, NULL);
+    return (double)now.tv_sec * 1000000.0 + (double)now.tv_usec;
+#endif
+}
+
+static int _hist_bucket(double us) {
+    int bucket = 0;
+
+    while (us >= 1.0 && bucket < THRD_HIST_BUCKETS - 1) {
+        us /= 2.0;
+        bucket++;
+    }
+    return bucket;
+}
+#endif
+
 #if defined(WINVER) && WINVER >= 0x0501
 static DWORD _count_set_bits(ULONG_PTR bitMask) {
     DWORD LSHIFT = sizeof(ULONG_PTR) * 8 - 1;
@@ -213,13 +336,128 @@ int ThreadPool::get_thrd_count() {
     return m_thrd_count;
 }
 
-ThreadPool::ThreadPool(int max_thrd_num /* = 0 */ ):m_pool_signaled(false), m_stop(true), m_thrd_count(max_thrd_num), m_active_thrd_count(0), m_thread_handle(NULL) {
+void ThreadPool::set_spin_count(int spin_count) {
+    LockScope lock(this->m_pool_lock);
+    m_spin_max = (spin_count > 0) ? spin_count : 0;
+    m_spin_limit = m_spin_max;
+    m_pool_lock.set_spin_count(m_spin_max > 0 ? THRD_SPIN_MIN : 0);
+}
+
+void ThreadPool::get_stats(ThreadPoolStats *stats) {
+    LockScope lock(this->m_pool_lock);
+    *stats = m_stats;
+    stats->spin_limit = m_spin_limit;
+    stats->queue_allocs = m_queue.allocs();
+    stats->queue_capacity = (long)m_queue.capacity();
+}
+
+bool ThreadPool::get_worker_stats(int index, ThreadWorkerStats *stats) {
+    LockScope lock(this->m_pool_lock);
+    if (!m_worker_stats || index < 0 || index >= m_thrd_count) {
+        return false;
+    }
+    *stats = m_worker_stats[index];
+    return true;
+}
+
+void ThreadPool::dump_stats(FILE *fp) {
+    ThreadPoolStats stats;
+
+    get_stats(&stats);
+    fprintf(fp, "Thread pool: %ld spin hits, %ld spin misses, %ld parks (spin limit=%d)\n",
+         stats.spin_hits, stats.spin_misses, stats.parks, stats.spin_limit);
+    fprintf(fp, "Thread pool: task ring capacity %ld, %ld allocations\n", stats.queue_capacity, stats.queue_allocs);
+#if THRD_POOL_PROFILE
+    if (stats.tasks <= 0) {
+        return;
+    }
+    fprintf(fp, "Thread pool: %ld add_tasks calls, enqueue avg %.2fus\n",
+         stats.enqueues, stats.enqueues > 0 ? stats.enqueue_us / stats.enqueues : 0.0);
+    fprintf(fp, "Thread pool: %ld tasks, queue depth avg %.2f max %ld, wait avg %.1fus, run avg %.1fus\n",
+         stats.tasks, stats.queue_depth_sum / stats.tasks, stats.max_queue_depth,
+         stats.wait_us / stats.tasks, stats.run_us / stats.tasks);
+    for (int i = 0; i < m_thrd_count; ++i) {
+        ThreadWorkerStats worker;
+
+        if (!get_worker_stats(i, &worker)) {
+            break;
+        }
+        fprintf(fp, "  worker %d: %ld tasks, %ld parks, run %.1fms, idle %.1fms (busy %.1f%%)\n",
+             i, worker.tasks, worker.parks, worker.run_us / 1000.0, worker.idle_us / 1000.0,
+             (worker.run_us + worker.idle_us > 0.0) ? worker.run_us * 100.0 / (worker.run_us + worker.idle_us) : 0.0);
+    }
+    for (int i = 0; i < THRD_HIST_BUCKETS; ++i) {
+        if (stats.wait_hist[i] || stats.run_hist[i]) {
+            fprintf(fp, "  < %8ldus: wait %ld, run %ld\n", 1L << i, stats.wait_hist[i], stats.run_hist[i]);
+        }
+    }
+#endif
+}
+
+bool ThreadPool::spin_wait(int limit) {
+    for (int i = 0; i < limit; ++i) {
+        if (m_queued > 0) {
+            return true;
+        }
+        THRD_CPU_PAUSE();
+    }
+    return false;
+}
+
+void ThreadPool::adapt_spin(bool found) {
+    if (found) {
+        m_stats.spin_hits++;
+        m_spin_limit = ((m_spin_limit << 1) < m_spin_max) ? (m_spin_limit << 1) : m_spin_max;
+    } else {
+        m_stats.spin_misses++;
+        m_spin_limit >>= 1;
+        if (m_spin_limit < THRD_SPIN_MIN) {
+            m_spin_limit = (THRD_SPIN_MIN < m_spin_max) ? THRD_SPIN_MIN : m_spin_max;
+        }
+    }
+}
+
+void ThreadPool::count_park(int worker) {
+    m_stats.parks++;
+    if (m_worker_stats && worker < m_thrd_count) {
+        m_worker_stats[worker].parks++;
+    }
+}
+
+#if THRD_POOL_PROFILE
+void ThreadPool::count_start(int worker, const ThrdContext &context, double idle_us, double now_us) {
+    double wait_us = now_us - context.enqueue_us;
+
+    m_stats.tasks++;
+    m_stats.wait_us += wait_us;
+    m_stats.wait_hist[_hist_bucket(wait_us)]++;
+    if (m_worker_stats && worker < m_thrd_count) {
+        m_worker_stats[worker].tasks++;
+        m_worker_stats[worker].idle_us += idle_us;
+    }
+}
+
+void ThreadPool::count_run(int worker, double run_us) {
+    m_stats.run_us += run_us;
+    m_stats.run_hist[_hist_bucket(run_us)]++;
+    if (m_worker_stats && worker < m_thrd_count) {
+        m_worker_stats[worker].run_us += run_us;
+    }
+}
+#endif
+
+ThreadPool::ThreadPool(int max_thrd_num /* = 0 */ ):m_pool_signaled(false), m_stop(true), m_thrd_count(max_thrd_num), m_active_thrd_count(0),
+    m_queued(0), m_spin_max(0), m_spin_limit(0), m_worker_seq(0), m_worker_stats(NULL), m_thread_handle(NULL) {
+    memset(&m_stats, 0x00, sizeof(m_stats));
     m_thrd_context.func = ThreadPool::thread_instance;
     m_thrd_context.param = this;
+    m_thrd_context.group = NULL;
+    set_spin_count(get_cpu_count() > 1 ? THRD_SPIN_COUNT : 0);
 }
 
 ThreadPool::~ThreadPool() {
     wait_all_thrd();
+    free(m_worker_stats);
     free(m_thread_handle);
 }
 
@@ -240,12 +478,16 @@ bool ThreadPool::init() {
         if (!m_thread_handle) {
             break;
         }
+        if (!m_worker_stats) {
+            m_worker_stats = (ThreadWorkerStats *)calloc(m_thrd_count, sizeof(ThreadWorkerStats));
+        }
         m_pool_lock.lock();
         if (!m_stop) {
             m_pool_lock.unlock();
             break;
         }
         m_stop = false;
+        m_worker_seq = 0;
         m_pool_lock.unlock();
         for (int i = 0; i < m_thrd_count; ++i) {
 #ifdef _WIN32
@@ -267,17 +509,67 @@ bool ThreadPool::init() {
     return ret;
 }
 
-void ThreadPool::add_task(thrd_callback func, void *param) {
-    LockScope lock(this->m_ctrl_lock);
+void ThreadPool::add_task(thrd_callback func, void *param, TaskGroup *group /* = NULL */ ) {
     ThrdContext context;
 
     context.func = func;
     context.param = param;
+    context.group = NULL;
+    add_tasks(&context, 1, group);
+}
+
+void ThreadPool::add_tasks(const ThrdContext *tasks, int count, TaskGroup *group /* = NULL */ ) {
+    int queued = 0;
+
+    if (count <= 0) {
+        return;
+    }
+    if (group) {
+        group->add(count, m_spin_max);
+    }
+
+#if THRD_POOL_PROFILE
+    double now_us = _clock_us();
+#endif
+
+    m_ctrl_lock.lock();
     m_pool_lock.lock();
-    m_queue.push_back(context);
-    m_pool_lock.signal();
+    for (; queued < count; ++queued) {
+        ThrdContext context = tasks[queued];
+
+        context.group = group;
+#if THRD_POOL_PROFILE
+        context.enqueue_us = now_us;
+#endif
+        if (!m_queue.push_back(context)) {
+            break;
+        }
+    }
+    m_queued += queued;
+#if THRD_POOL_PROFILE
+    m_stats.queue_depth_sum += (double)m_queued * queued;
+    if (m_queued > m_stats.max_queue_depth) {
+        m_stats.max_queue_depth = m_queued;
+    }
+    m_stats.enqueues++;
+    m_stats.enqueue_us += _clock_us() - now_us;
+#endif
+    if (queued == 1) {
+        m_pool_lock.signal();
+    } else if (queued > 1) {
+        m_pool_lock.broadcast();
+    }
     m_pool_signaled = true;
     m_pool_lock.unlock();
+    m_ctrl_lock.unlock();
+
+    /* the ring could not grow, run what is left on the caller's thread */
+    for (; queued < count; ++queued) {
+        tasks[queued].func(tasks[queued].param);
+        if (group) {
+            group->done();
+        }
+    }
 }
 
 void ThreadPool::wait_all_task() {
@@ -287,6 +579,13 @@ void ThreadPool::wait_all_task() {
         m_pool_lock.unlock();
         return;
     }
+    if (m_spin_max > 0 && (!m_queue.empty() || m_active_thrd_count > 0)) {
+        m_pool_lock.unlock();
+        for (int i = 0; i < m_spin_max && (m_queued > 0 || m_active_thrd_count > 0); ++i) {
+            THRD_CPU_PAUSE();
+        }
+        m_pool_lock.lock();
+    }
     while (!m_queue.empty() || m_active_thrd_count > 0) {
         m_pool_lock.wait();
     }
@@ -319,33 +618,65 @@ void ThreadPool::wait_all_thrd() {
 
 void ThreadPool::thread_instance(void *param) {
     ThreadPool *pthis = (ThreadPool *)param;
+    bool spin = true;
+#if THRD_POOL_PROFILE
+    double idle_start = _clock_us();
+#endif
+
+    pthis->m_pool_lock.lock();
+    int worker = pthis->m_worker_seq++;
 
     while (true) {
-        pthis->m_pool_lock.lock();
         if (pthis->m_queue.empty()) {
             if (pthis->m_stop) {
-                pthis->m_pool_lock.unlock();
                 break;
             }
             pthis->m_pool_signaled = false;
             if (pthis->m_active_thrd_count == 0) {
                 pthis->m_pool_lock.broadcast();
             }
+            if (spin && pthis->m_spin_limit > 0) {
+                int limit = pthis->m_spin_limit;
+
+                pthis->m_pool_lock.unlock();
+                bool found = pthis->spin_wait(limit);
+
+                pthis->m_pool_lock.lock();
+                pthis->adapt_spin(found);
+                spin = false;
+                continue;
+            }
             while (!pthis->m_pool_signaled) {
                 pthis->m_pool_lock.wait();
             }
-            pthis->m_pool_lock.unlock();
+            pthis->count_park(worker);
+            spin = true;
             continue;
         }
         ThrdContext context = pthis->m_queue.front();
 
         pthis->m_queue.pop_front();
+        pthis->m_queued--;
         pthis->m_active_thrd_count++;
+#if THRD_POOL_PROFILE
+        double start = _clock_us();
+
+        pthis->count_start(worker, context, start - idle_start, start);
+#endif
         pthis->m_pool_lock.unlock();
         context.func(context.param);
+#if THRD_POOL_PROFILE
+        idle_start = _clock_us();
+#endif
+        if (context.group) {
+            ((TaskGroup *)context.group)->done();
+        }
         pthis->m_pool_lock.lock();
         pthis->m_active_thrd_count--;
-        pthis->m_pool_lock.unlock();
+#if THRD_POOL_PROFILE
+        pthis->count_run(worker, idle_start - start);
+#endif
+        spin = true;
     }
+    pthis->m_pool_lock.unlock();
 }
-
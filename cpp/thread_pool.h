@@ -32,6 +32,7 @@ typedef pthread_cond_t ConditionVariable;
 typedef pthread_t THRD_HANDLE;
 #define THRD_INST void*
 #endif
+#include <stdio.h>
 
 #if defined(max)
 #undef max
@@ -40,27 +41,114 @@ typedef pthread_t THRD_HANDLE;
 #undef min
 #endif
 
+#if defined(_WIN32) && defined(YieldProcessor)
+#define THRD_CPU_PAUSE() YieldProcessor()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define THRD_CPU_PAUSE() __asm__ __volatile__("rep; nop" ::: "memory")
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define THRD_CPU_PAUSE() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define THRD_CPU_PAUSE() ((void)0)
+#endif
+
+#ifndef THRD_SPIN_COUNT
+#define THRD_SPIN_COUNT 2000
+#endif
+#define THRD_SPIN_MIN 64
+
+#ifndef THRD_POOL_PROFILE
+#define THRD_POOL_PROFILE 0
+#endif
+#define THRD_HIST_BUCKETS 24
+
+#ifndef THRD_CACHE_LINE
+#define THRD_CACHE_LINE 64
+#endif
+#define THRD_QUEUE_INIT_SIZE 64
+
 typedef void (*thrd_callback)(void *param);
 
 typedef struct {
     thrd_callback func;
     void *param;
+    void *group;
+#if THRD_POOL_PROFILE
+    double enqueue_us;
+#endif
 } ThrdContext;
 
+typedef struct {
+    long tasks;
+    long parks;
+    double run_us;
+    double idle_us;
+} ThreadWorkerStats;
+
+typedef struct {
+    long spin_hits;
+    long spin_misses;
+    long parks;
+    int spin_limit;
+    long tasks;
+    long max_queue_depth;
+    double queue_depth_sum;
+    double wait_us;
+    double run_us;
+    long wait_hist[THRD_HIST_BUCKETS];
+    long run_hist[THRD_HIST_BUCKETS];
+    long queue_allocs;
+    long queue_capacity;
+    long enqueues;
+    double enqueue_us;
+} ThreadPoolStats;
+
 #ifdef __cplusplus
 }
 #endif
 
-#if defined(__GNUC__) && __GNUC__ == 2 && __GNUC_MINOR__ < 8
-#include <deque.h>
-typedef deque<ThrdContext> ThreadQueue;
-#elif defined(_MSC_VER) && _MSC_VER < 1100
-#include <deque>
-typedef deque<ThrdContext, allocator<ThrdContext> > ThreadQueue;
-#else
-#include <deque>
-typedef std::deque<ThrdContext> ThreadQueue;
-#endif
+/*
+ * Power-of-two ring of tasks, doubled when full and never shrunk, so pushing
+ * allocates only while the pool reaches a new peak backlog. head and tail sit
+ * on separate cache lines since idle workers poll the ring.
+ */
+class ThreadQueue {
+public:
+    ThreadQueue();
+    ~ThreadQueue();
+
+    bool push_back(const ThrdContext &context);
+    ThrdContext &front() {
+        return m_buf[m_head & m_mask];
+    }
+    void pop_front() {
+        m_head++;
+    }
+    bool empty() const {
+        return m_head == m_tail;
+    }
+    unsigned long size() const {
+        return m_tail - m_head;
+    }
+    unsigned long capacity() const {
+        return m_buf ? m_mask + 1 : 0;
+    }
+    long allocs() const {
+        return m_allocs;
+    }
+
+private:
+    ThreadQueue(const ThreadQueue&);
+    ThreadQueue& operator=(ThreadQueue&);
+    bool grow();
+    ThrdContext *m_buf;
+    unsigned long m_mask;
+    long m_allocs;
+    char m_pad0[THRD_CACHE_LINE];
+    volatile unsigned long m_head;
+    char m_pad1[THRD_CACHE_LINE - sizeof(unsigned long)];
+    volatile unsigned long m_tail;
+    char m_pad2[THRD_CACHE_LINE - sizeof(unsigned long)];
+};
 
 class ThreadLock {
 public:
@@ -69,6 +157,7 @@ public:
 
     void lock();
     void unlock();
+    void set_spin_count(int spin_count);
 
     bool wait(int timeout_ms = -1);
     void signal();
@@ -96,6 +185,7 @@ private:
 
     CriticalSection m_mutex;
     ConditionVariable m_cond;
+    int m_spin_count;
 };
 
 class LockScope {
@@ -116,22 +206,53 @@ private:
     ThreadLock &m_lock;
 };
 
+class TaskGroup {
+public:
+    TaskGroup();
+    ~TaskGroup();
+
+    void wait();
+    int pending();
+
+private:
+    friend class ThreadPool;
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(TaskGroup&);
+    void add(int count, int spin_count);
+    void done();
+    ThreadLock m_lock;
+    volatile int m_pending;
+    int m_spin_count;
+};
+
 class ThreadPool {
 public:
     ThreadPool(int max_thrd_num = 0);
     ~ThreadPool();
 
     bool init();
-    void add_task(thrd_callback func, void *param);
+    void add_task(thrd_callback func, void *param, TaskGroup *group = NULL);
+    void add_tasks(const ThrdContext *tasks, int count, TaskGroup *group = NULL);
     void wait_all_task();
     void wait_all_thrd();
     int get_thrd_count();
+    void set_spin_count(int spin_count);
+    void get_stats(ThreadPoolStats *stats);
+    bool get_worker_stats(int index, ThreadWorkerStats *stats);
+    void dump_stats(FILE *fp);
 
     static int get_cpu_count();
 
 private:
     static void thread_instance(void *param);
     static THRD_INST _threadstart(void *param);
+    bool spin_wait(int limit);
+    void adapt_spin(bool found);
+    void count_park(int worker);
+#if THRD_POOL_PROFILE
+    void count_start(int worker, const ThrdContext &context, double idle_us, double now_us);
+    void count_run(int worker, double run_us);
+#endif
     ThreadQueue m_queue;
     ThrdContext m_thrd_context;
     ThreadLock m_pool_lock;
@@ -139,7 +260,13 @@ private:
     bool m_pool_signaled;
     bool m_stop;
     int m_thrd_count;
-    int m_active_thrd_count;
+    volatile int m_active_thrd_count;
+    volatile int m_queued;
+    int m_spin_max;
+    int m_spin_limit;
+    int m_worker_seq;
+    ThreadPoolStats m_stats;
+    ThreadWorkerStats *m_worker_stats;
     THRD_HANDLE *m_thread_handle;
 };
 